@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include "TFile.h"
+#include "TStopwatch.h"
+#include "TTree.h"
+
+#include "Benchmark.h"
+#include "Config.h"
+#include "CutKernel.h"
+#include "DataSet.h"
+#include "EventBuilder.h"
+#include "EventInfoPrinter.h"
+#include "EventYieldPrinter.h"
+#include "Filter.h"
+#include "FilterProgram.h"
+#include "GlobalParameters.h"
+#include "HistFiller.h"
+#include "Selection.h"
+#include "Style.h"
+#include "Variable.h"
+
+
+const TString Benchmark::dir_ = "benchmark";
+
+
+int main(int argc, char *argv[]) {
+  unsigned int nEvts = 1000000;
+  unsigned int nBranches = 12;
+  if( argc > 1 ) nEvts = atoi(argv[1]);
+  if( argc > 2 ) nBranches = atoi(argv[2]);
+  if( nEvts == 0 || nBranches == 0 ) {
+    std::cerr << "\n\n  ERROR: Wrong number of events or branches" << std::endl;
+    std::cerr << "  Usage './bench [number of events] [number of branches]\n" << std::endl;
+    return 0;
+  }
+  Benchmark* bm = new Benchmark(nEvts,nBranches);
+  delete bm;
+
+  return 0;
+}
+
+
+Benchmark::Benchmark(unsigned int nEvts, unsigned int nBranches)
+  : nEvts_(nEvts), nBranches_(nBranches), store_(0) {
+  std::cout << "Initializing benchmark" << std::endl;
+  mkdir(dir_.Data(),S_IRWXU);
+  const TString treeFileName = dir_+"/Benchmark_Synthetic.root";
+  const TString configFileName = dir_+"/Benchmark.txt";
+  std::cout << "  Creating synthetic tree '" << treeFileName << "'...  " << std::flush;
+  createTree(treeFileName);
+  std::cout << "ok" << std::endl;
+  createConfig(configFileName,treeFileName);
+
+  runPipeline(configFileName,treeFileName);
+
+  // One cut of each type on the first variable, which is a Double_t
+  const TString var = varName(0);
+  cuts_.push_back(Cut::create(var+" > 500",0));
+  cuts_.push_back(Cut::create(var+" >= 500",0));
+  cuts_.push_back(Cut::create(var+" < 500",0));
+  cuts_.push_back(Cut::create(var+" <= 500",0));
+  cuts_.push_back(Cut::create(var+" == 500",0));
+  cuts_.push_back(Cut::create(var+" != 500",0));
+  cuts_.push_back(Cut::create("250 < "+var+" < 750",0));
+  cuts_.push_back(Cut::create("250 <= "+var+" <= 750",0));
+  runCuts();
+}
+
+
+Benchmark::~Benchmark() {
+  delete store_;
+  DataSet::clear();
+  Selection::clear();
+}
+
+
+// The types supported by Variable, in turn
+// ---------------------------------------------------------------
+TString Benchmark::type(unsigned int branch) {
+  const char* types[] = { "Double_t", "Float_t", "Int_t", "UInt_t", "UShort_t", "UChar_t" };
+
+  return types[branch%6];
+}
+
+
+// ---------------------------------------------------------------
+TString Benchmark::varName(unsigned int branch) {
+  TString name = "Var";
+  name += branch;
+
+  return name;
+}
+
+
+// Peak resident set size of the process in MB
+// ---------------------------------------------------------------
+double Benchmark::peakRSS() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+
+  return usage.ru_maxrss/1024.;	// ru_maxrss is in kB
+}
+
+
+// Tree 'Events' with the provenance variables, a weight with up
+// and down variations, and the variables. The values are uniformly
+// distributed in [0,1000), or in [0,256) for UChar_t.
+// ---------------------------------------------------------------
+void Benchmark::createTree(const TString &fileName) const {
+  TFile file(fileName,"RECREATE");
+  if( file.IsZombie() ) {
+    std::cerr << "\n\nERROR in Benchmark::createTree(): cannot create file '" << fileName << "'" << std::endl;
+    exit(-1);
+  }
+  TTree* tree = new TTree("Events","Synthetic events");
+
+  UInt_t runNum = 1;
+  UInt_t lumiBlockNum = 1;
+  UInt_t evtNum = 0;
+  Float_t weight = 1.;
+  Float_t weightDn = 1.;
+  Float_t weightUp = 1.;
+  tree->Branch("RunNum",&runNum,"RunNum/i");
+  tree->Branch("LumiBlockNum",&lumiBlockNum,"LumiBlockNum/i");
+  tree->Branch("EvtNum",&evtNum,"EvtNum/i");
+  tree->Branch("Weight",&weight,"Weight/F");
+  tree->Branch("WeightDn",&weightDn,"WeightDn/F");
+  tree->Branch("WeightUp",&weightUp,"WeightUp/F");
+
+  std::vector<Double_t> varsDouble_t(nBranches_,0.);
+  std::vector<Float_t> varsFloat_t(nBranches_,0.);
+  std::vector<Int_t> varsInt_t(nBranches_,0);
+  std::vector<UInt_t> varsUInt_t(nBranches_,0);
+  std::vector<UShort_t> varsUShort_t(nBranches_,0);
+  std::vector<UChar_t> varsUChar_t(nBranches_,0);
+  for(unsigned int b = 0; b < nBranches_; ++b) {
+    const TString name = varName(b);
+    if( type(b) == "Double_t" ) tree->Branch(name,&varsDouble_t.at(b),name+"/D");
+    else if( type(b) == "Float_t" ) tree->Branch(name,&varsFloat_t.at(b),name+"/F");
+    else if( type(b) == "Int_t" ) tree->Branch(name,&varsInt_t.at(b),name+"/I");
+    else if( type(b) == "UInt_t" ) tree->Branch(name,&varsUInt_t.at(b),name+"/i");
+    else if( type(b) == "UShort_t" ) tree->Branch(name,&varsUShort_t.at(b),name+"/s");
+    else if( type(b) == "UChar_t" ) tree->Branch(name,&varsUChar_t.at(b),name+"/b");
+  }
+
+  srand(1);
+  for(unsigned int i = 0; i < nEvts_; ++i) {
+    lumiBlockNum = 1 + i/10000;
+    evtNum = i;
+    weight = 0.5 + (rand()%1000)/1000.;
+    weightDn = 0.9*weight;
+    weightUp = 1.1*weight;
+    for(unsigned int b = 0; b < nBranches_; ++b) {
+      const int val = rand()%1000;
+      varsDouble_t.at(b) = val;
+      varsFloat_t.at(b) = val;
+      varsInt_t.at(b) = val;
+      varsUInt_t.at(b) = val;
+      varsUShort_t.at(b) = val;
+      varsUChar_t.at(b) = val%256;
+    }
+    tree->Fill();
+  }
+  file.Write();
+  file.Close();
+}
+
+
+// Config with one dataset of the synthetic tree, selections on the
+// first variables, and the event-info printout
+// ---------------------------------------------------------------
+void Benchmark::createConfig(const TString &fileName, const TString &treeFileName) const {
+  std::ofstream file(fileName.Data());
+  if( !file.is_open() ) {
+    std::cerr << "\n\nERROR in Benchmark::createConfig(): cannot create file '" << fileName << "'" << std::endl;
+    exit(-1);
+  }
+  file << "global :: id: Benchmark" << std::endl;
+  file << "global :: input path: ./" << std::endl;
+  file << "variable :: name: RunNum; type: UInt_t" << std::endl;
+  file << "variable :: name: LumiBlockNum; type: UInt_t" << std::endl;
+  file << "variable :: name: EvtNum; type: UInt_t" << std::endl;
+  file << "variable :: name: Weight; type: Float_t" << std::endl;
+  file << "variable :: name: WeightDn; type: Float_t" << std::endl;
+  file << "variable :: name: WeightUp; type: Float_t" << std::endl;
+  for(unsigned int b = 0; b < nBranches_; ++b) {
+    file << "variable :: name: " << varName(b) << "; type: " << type(b) << std::endl;
+  }
+  file << "dataset :: label: Synthetic; type: mc; files: " << treeFileName << "; tree: Events; weight: Weight; uncertainty Weight: -WeightDn, +WeightUp" << std::endl;
+  const TString var1 = nBranches_ > 1 ? varName(1) : varName(0);
+  file << "selection :: label: loose; cuts: " << varName(0) << " > 100" << std::endl;
+  file << "selection :: label: tight; cuts: loose && " << var1 << " > 500" << std::endl;
+  file << "selection :: label: window; cuts: 250 < " << varName(0) << " < 750 || " << var1 << " <= 100" << std::endl;
+  file << "print event info :: provenance variables: RunNum + LumiBlockNum + EvtNum; selections: tight, window" << std::endl;
+  file << "print event info :: highest: " << varName(0) << ", 100; selections: tight, window" << std::endl;
+}
+
+
+// Runs the steps of MrRA2 on the synthetic tree. The screen output
+// of the printers is suppressed.
+// ---------------------------------------------------------------
+void Benchmark::runPipeline(const TString &configFileName, const TString &treeFileName) {
+  Config cfg(configFileName);
+  GlobalParameters::init(cfg,"global");
+  Style::init(cfg,"style");
+  Variable::init(cfg,"variable");
+  // Read all variables, as if all of them were plotted
+  for(std::vector<TString>::const_iterator itv = Variable::begin(); itv != Variable::end(); ++itv) {
+    Variable::use(*itv);
+  }
+  Selection::init(cfg,"selection");
+  EventInfoPrinter::useVariables(cfg);
+  DataSet::init(cfg,"dataset");
+  const DataSet* dataSet = DataSet::findAllUnselected().front();
+  std::vector<TString> uncLabels(dataSet->systLabelsBegin(),dataSet->systLabelsEnd());
+  std::vector<TString> uncDn(1,"WeightDn");
+  std::vector<TString> uncUp(1,"WeightUp");
+
+  std::cout << "\n  " << nEvts_ << " events, " << Variable::nVars() << " variables, " << nReps_ << " repetitions\n" << std::endl;
+  std::cout << "  " << std::setw(36) << std::left << "step" << std::right;
+  std::cout << std::setw(16) << "10^6 events / s" << std::setw(18) << "peak RSS [MB]" << std::endl;
+  TStopwatch timer;
+
+  // Read all variables of the tree, entry by entry and basket by basket
+  const EventBuilder ebd;
+  store_ = new EventStore(uncLabels);
+  timer.Start();
+  ebd(treeFileName,"Events","Weight",uncDn,uncUp,uncLabels,1.,*store_);
+  timer.Stop();
+  report("EventBuilder",store_->size(),timer.RealTime());
+  const EventBuilder ebdBulk("",true);
+  EventStore bulkStore(uncLabels);
+  timer.Start();
+  ebdBulk(treeFileName,"Events","Weight",uncDn,uncUp,uncLabels,1.,bulkStore);
+  timer.Stop();
+  report("EventBuilder (bulk read)",bulkStore.size(),timer.RealTime());
+
+  // Evaluate the compiled filter of each selection
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    timer.Start();
+    for(unsigned int rep = 0; rep < nReps_; ++rep) {
+      EventMask mask(store_->size());
+      (*its)->apply(*store_,dataSet->label(),mask);
+    }
+    timer.Stop();
+    report("Selection::apply "+(*its)->uid(),nReps_*store_->size(),timer.RealTime());
+  }
+
+  // Yield and uncertainties of the unselected and selected datasets
+  DataSets dataSets = DataSet::findAllWithLabel(dataSet->label());
+  timer.Start();
+  for(unsigned int rep = 0; rep < nReps_; ++rep) {
+    for(DataSetIt itd = dataSets.begin(); itd != dataSets.end(); ++itd) {
+      const_cast<DataSet*>(*itd)->computeYield(uncLabels);
+    }
+  }
+  timer.Stop();
+  report("DataSet::computeYield",nReps_*dataSet->size(),timer.RealTime());
+
+  // Distributions of all variables, as filled for the control plots
+  HistFiller filler;
+  for(DataSetIt itd = dataSets.begin(); itd != dataSets.end(); ++itd) {
+    for(std::vector<TString>::const_iterator itv = Variable::begin(); itv != Variable::end(); ++itv) {
+      filler.book1D(*itd,*itv,100,0.,1000.);
+    }
+  }
+  timer.Start();
+  for(unsigned int rep = 0; rep < nReps_; ++rep) {
+    filler.fill();
+  }
+  timer.Stop();
+  report("HistFiller::fill",nReps_*dataSet->size(),timer.RealTime());
+
+  // Printers
+  std::ofstream devNull("/dev/null");
+  std::streambuf* coutBuf = std::cout.rdbuf(devNull.rdbuf());
+  timer.Start();
+  EventInfoPrinter evtInfoPrinter(cfg);
+  evtInfoPrinter.run();
+  timer.Stop();
+  const double timeInfo = timer.RealTime();
+  timer.Start();
+  EventYieldPrinter evtYieldPrinter;
+  timer.Stop();
+  const double timeYield = timer.RealTime();
+  std::cout.rdbuf(coutBuf);
+  report("EventInfoPrinter",dataSet->size(),timeInfo);
+  report("EventYieldPrinter",dataSet->size(),timeYield);
+  std::cout << std::endl;
+}
+
+
+// ---------------------------------------------------------------
+void Benchmark::runCuts() const {
+  const CutKernel::InstructionSet best = CutKernel::best();
+
+  std::cout << "  Throughput in 10^6 events / s" << std::endl;
+  std::cout << "  " << std::setw(28) << std::left << "cut" << std::right;
+  std::cout << std::setw(12) << "per-event";
+  for(int is = CutKernel::Scalar; is <= best; ++is) {
+    std::cout << std::setw(12) << CutKernel::name(static_cast<CutKernel::InstructionSet>(is));
+  }
+  std::cout << std::endl;
+
+  for(std::vector<const Cut*>::const_iterator it = cuts_.begin();
+      it != cuts_.end(); ++it) {
+    std::cout << "  " << std::setw(28) << std::left << (*it)->uid() << std::right << std::fixed << std::setprecision(1);
+    unsigned int nPassRef = 0;
+    std::cout << std::setw(12) << 1E-6*nReps_*store_->size()/runPerEvent(*it,nPassRef) << std::flush;
+    for(int is = CutKernel::Scalar; is <= best; ++is) {
+      CutKernel::select(static_cast<CutKernel::InstructionSet>(is));
+      unsigned int nPass = 0;
+      std::cout << std::setw(12) << 1E-6*nReps_*store_->size()/runBatch(*it,nPass) << std::flush;
+      if( nPass != nPassRef ) {
+	std::cerr << "\n\nERROR in Benchmark::runCuts(): " << CutKernel::name(static_cast<CutKernel::InstructionSet>(is)) << " kernel selects " << nPass << " instead of " << nPassRef << " events" << std::endl;
+	exit(-1);
+      }
+    }
+    std::cout << std::endl;
+  }
+  CutKernel::select(best);
+}
+
+
+// Returns the real time in seconds
+// ---------------------------------------------------------------
+double Benchmark::runPerEvent(const Cut* cut, unsigned int &nPass) const {
+  const Filter* filter = cut;
+  TStopwatch timer;
+  timer.Start();
+  for(unsigned int rep = 0; rep < nReps_; ++rep) {
+    nPass = 0;
+    for(unsigned int i = 0; i < store_->size(); ++i) {
+      if( filter->passes(Event(store_,i)) ) ++nPass;
+    }
+  }
+  timer.Stop();
+
+  return timer.RealTime();
+}
+
+
+// Returns the real time in seconds
+// ---------------------------------------------------------------
+double Benchmark::runBatch(const Cut* cut, unsigned int &nPass) const {
+  const std::vector<double> &x = store_->column(cut->var());
+  std::vector<unsigned char> mask(FilterProgram::blockSize_);
+  TStopwatch timer;
+  timer.Start();
+  for(unsigned int rep = 0; rep < nReps_; ++rep) {
+    nPass = 0;
+    for(unsigned int start = 0; start < x.size(); start += FilterProgram::blockSize_) {
+      const unsigned int n = std::min(FilterProgram::blockSize_,static_cast<unsigned int>(x.size())-start);
+      cut->passes(&(x[start]),n,&(mask[0]));
+      for(unsigned int i = 0; i < n; ++i) nPass += mask[i];
+    }
+  }
+  timer.Stop();
+
+  return timer.RealTime();
+}
+
+
+// ---------------------------------------------------------------
+void Benchmark::report(const TString &step, double nEvts, double realTime) const {
+  std::cout << "  " << std::setw(36) << std::left << step << std::right << std::fixed << std::setprecision(1);
+  std::cout << std::setw(16) << 1E-6*nEvts/realTime << std::setw(18) << peakRSS() << std::endl;
+}
@@ -0,0 +1,50 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <vector>
+
+#include "TString.h"
+
+#include "Event.h"
+
+class Cut;
+
+
+// Measures the throughput (events per second) and the peak memory
+// of the processing steps on a synthetic ROOT tree. The tree and a
+// config file using it are generated in the directory 'benchmark'; the
+// tree has the provenance variables, a weight with uncertainties,
+// and 'nBranches' variables cycling through the types supported
+// by Variable. The benchmarked steps are the EventBuilder, the
+// selections, the yield computation, the histogram filling, and
+// the printers. In addition, for each cut type, the per-event
+// virtual Filter::passes() is compared to the batch Cut::passes()
+// with each of the supported CutKernel instruction sets.
+class Benchmark {
+public:
+  Benchmark(unsigned int nEvts, unsigned int nBranches);
+  ~Benchmark();
+
+
+private:
+  static const unsigned int nReps_ = 10;
+  static const TString dir_;
+
+  const unsigned int nEvts_;
+  const unsigned int nBranches_;
+  EventStore* store_;
+  std::vector<const Cut*> cuts_;
+
+  static TString type(unsigned int branch);
+  static TString varName(unsigned int branch);
+  static double peakRSS();
+
+  void createTree(const TString &fileName) const;
+  void createConfig(const TString &fileName, const TString &treeFileName) const;
+  void runPipeline(const TString &configFileName, const TString &treeFileName);
+  void runCuts() const;
+  double runPerEvent(const Cut* cut, unsigned int &nPass) const;
+  double runBatch(const Cut* cut, unsigned int &nPass) const;
+  void report(const TString &step, double nEvts, double realTime) const;
+};
+#endif
@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -5,6 +6,7 @@
 #include "Rtypes.h"
 
 #include "Config.h"
+#include "Profiler.h"
 
 
 // Constructor. Parses the configfile and stores the definitions.
@@ -20,7 +22,7 @@
 // ----------------------------------------------------------------------------
 Config::Config(const TString &fileName) 
   : fileName_(fileName), keyAndAttributesDelimiter_("::"), attributeNameAndValueDelimiter_(":") {
-
+  Profiler::Timer timer("Config");
 
   // Open file for reading
   std::ifstream file(fileName_.Data());
@@ -232,6 +234,20 @@ int Config::color(const TString &cfg) {
 }
 
 
+// ----------------------------------------------------------------------------
+TString Config::hash(const TString &str) {
+  ULong64_t hash = 14695981039346656037ULL;
+  for(int i = 0; i < str.Length(); ++i) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= 1099511628211ULL;
+  }
+  char hex[17];
+  snprintf(hex,17,"%08x%08x",static_cast<UInt_t>(hash >> 32),static_cast<UInt_t>(hash));
+
+  return hex;
+}
+
+
 TString Config::Attributes::value(const TString &name) const {
   TString val = "";
   std::map<TString,Value>::const_iterator it = values_.find(name);
@@ -65,6 +65,8 @@ public:
   static TString after(const TString &str, const TString &delim);
   static bool enclosed(const TString &str, const TString &delimStart, const TString &delimEnd, TString &encl);
   static int color(const TString &cfg);
+  // 64-bit FNV-1a hash of 'str' as 16 hex digits
+  static TString hash(const TString &str);
 
 
   // Each config object parses the config file
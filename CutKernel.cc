@@ -0,0 +1,223 @@
+#include <cstring>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define CUT_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#include "CutKernel.h"
+
+
+bool CutKernel::isInit_ = false;
+CutKernel::InstructionSet CutKernel::instructionSet_ = CutKernel::Scalar;
+CutKernel::Kernel CutKernel::greaterThan_ = 0;
+CutKernel::Kernel CutKernel::greaterEqualThan_ = 0;
+CutKernel::Kernel CutKernel::lessThan_ = 0;
+CutKernel::Kernel CutKernel::lessEqualThan_ = 0;
+CutKernel::Kernel CutKernel::equal_ = 0;
+CutKernel::Kernel CutKernel::notEqual_ = 0;
+CutKernel::Kernel CutKernel::lessThanLessThan_ = 0;
+CutKernel::Kernel CutKernel::lessEqualThanLessEqualThan_ = 0;
+
+
+namespace {
+  // The comparisons. The SIMD predicates are chosen such that
+  // they give the same result as the scalar ones also for NaN.
+  enum Comparison { GT, GE, LT, LE, EQ, NE };
+
+  inline bool compare(Comparison cmp, double x, double val) {
+    switch( cmp ) {
+    case GT: return x > val;
+    case GE: return x >= val;
+    case LT: return x < val;
+    case LE: return x <= val;
+    case EQ: return x == val;
+    case NE: return x != val;
+    }
+    return false;
+  }
+
+
+  template<Comparison cmp>
+  void scalar(const double* x, unsigned int n, double val, double, unsigned char* mask) {
+    for(unsigned int i = 0; i < n; ++i) mask[i] = compare(cmp,x[i],val);
+  }
+
+
+  // The range cuts, with comparisons cmp1 to val1 and cmp2 to val2
+  template<Comparison cmp1, Comparison cmp2>
+  void scalarRange(const double* x, unsigned int n, double val1, double val2, unsigned char* mask) {
+    for(unsigned int i = 0; i < n; ++i) mask[i] = compare(cmp1,x[i],val1) && compare(cmp2,x[i],val2);
+  }
+
+
+#ifdef CUT_KERNEL_X86
+  // Expands 8 bits into 8 mask bytes of value 0 or 1
+  class ByteTable {
+  public:
+    ByteTable() {
+      for(unsigned int bits = 0; bits < 256; ++bits) {
+	for(unsigned int i = 0; i < 8; ++i) bytes_[bits][i] = (bits >> i) & 1;
+      }
+    }
+    void store(unsigned int bits, unsigned char* mask) const { std::memcpy(mask,bytes_[bits],8); }
+
+  private:
+    unsigned char bytes_[256][8];
+  };
+  const ByteTable byteTable;
+
+
+  __attribute__((target("sse2")))
+  inline __m128d sse2Compare(Comparison cmp, __m128d x, __m128d val) {
+    switch( cmp ) {
+    case GT: return _mm_cmpgt_pd(x,val);
+    case GE: return _mm_cmpge_pd(x,val);
+    case LT: return _mm_cmplt_pd(x,val);
+    case LE: return _mm_cmple_pd(x,val);
+    case EQ: return _mm_cmpeq_pd(x,val);
+    case NE: return _mm_cmpneq_pd(x,val);
+    }
+    return _mm_setzero_pd();
+  }
+
+
+  template<Comparison cmp>
+  __attribute__((target("sse2")))
+  void sse2(const double* x, unsigned int n, double val, double, unsigned char* mask) {
+    const __m128d v = _mm_set1_pd(val);
+    unsigned int i = 0;
+    for(; i+8 <= n; i += 8) {
+      unsigned int bits = _mm_movemask_pd(sse2Compare(cmp,_mm_loadu_pd(x+i),v));
+      bits |= _mm_movemask_pd(sse2Compare(cmp,_mm_loadu_pd(x+i+2),v)) << 2;
+      bits |= _mm_movemask_pd(sse2Compare(cmp,_mm_loadu_pd(x+i+4),v)) << 4;
+      bits |= _mm_movemask_pd(sse2Compare(cmp,_mm_loadu_pd(x+i+6),v)) << 6;
+      byteTable.store(bits,mask+i);
+    }
+    scalar<cmp>(x+i,n-i,val,0.,mask+i);
+  }
+
+
+  template<Comparison cmp1, Comparison cmp2>
+  __attribute__((target("sse2")))
+  void sse2Range(const double* x, unsigned int n, double val1, double val2, unsigned char* mask) {
+    const __m128d v1 = _mm_set1_pd(val1);
+    const __m128d v2 = _mm_set1_pd(val2);
+    unsigned int i = 0;
+    for(; i+8 <= n; i += 8) {
+      unsigned int bits = 0;
+      for(unsigned int j = 0; j < 8; j += 2) {
+	const __m128d xj = _mm_loadu_pd(x+i+j);
+	bits |= _mm_movemask_pd(_mm_and_pd(sse2Compare(cmp1,xj,v1),sse2Compare(cmp2,xj,v2))) << j;
+      }
+      byteTable.store(bits,mask+i);
+    }
+    scalarRange<cmp1,cmp2>(x+i,n-i,val1,val2,mask+i);
+  }
+
+
+  // Ordered predicates except for NE, which is true for NaN
+  __attribute__((target("avx2")))
+  inline __m256d avx2Compare(Comparison cmp, __m256d x, __m256d val) {
+    switch( cmp ) {
+    case GT: return _mm256_cmp_pd(x,val,_CMP_GT_OQ);
+    case GE: return _mm256_cmp_pd(x,val,_CMP_GE_OQ);
+    case LT: return _mm256_cmp_pd(x,val,_CMP_LT_OQ);
+    case LE: return _mm256_cmp_pd(x,val,_CMP_LE_OQ);
+    case EQ: return _mm256_cmp_pd(x,val,_CMP_EQ_OQ);
+    case NE: return _mm256_cmp_pd(x,val,_CMP_NEQ_UQ);
+    }
+    return _mm256_setzero_pd();
+  }
+
+
+  template<Comparison cmp>
+  __attribute__((target("avx2")))
+  void avx2(const double* x, unsigned int n, double val, double, unsigned char* mask) {
+    const __m256d v = _mm256_set1_pd(val);
+    unsigned int i = 0;
+    for(; i+8 <= n; i += 8) {
+      unsigned int bits = _mm256_movemask_pd(avx2Compare(cmp,_mm256_loadu_pd(x+i),v));
+      bits |= _mm256_movemask_pd(avx2Compare(cmp,_mm256_loadu_pd(x+i+4),v)) << 4;
+      byteTable.store(bits,mask+i);
+    }
+    scalar<cmp>(x+i,n-i,val,0.,mask+i);
+  }
+
+
+  template<Comparison cmp1, Comparison cmp2>
+  __attribute__((target("avx2")))
+  void avx2Range(const double* x, unsigned int n, double val1, double val2, unsigned char* mask) {
+    const __m256d v1 = _mm256_set1_pd(val1);
+    const __m256d v2 = _mm256_set1_pd(val2);
+    unsigned int i = 0;
+    for(; i+8 <= n; i += 8) {
+      const __m256d xlo = _mm256_loadu_pd(x+i);
+      const __m256d xhi = _mm256_loadu_pd(x+i+4);
+      unsigned int bits = _mm256_movemask_pd(_mm256_and_pd(avx2Compare(cmp1,xlo,v1),avx2Compare(cmp2,xlo,v2)));
+      bits |= _mm256_movemask_pd(_mm256_and_pd(avx2Compare(cmp1,xhi,v1),avx2Compare(cmp2,xhi,v2))) << 4;
+      byteTable.store(bits,mask+i);
+    }
+    scalarRange<cmp1,cmp2>(x+i,n-i,val1,val2,mask+i);
+  }
+#endif
+}
+
+
+
+// ---------------------------------------------------------------
+CutKernel::InstructionSet CutKernel::best() {
+#ifdef CUT_KERNEL_X86
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports("avx2") ) return AVX2;
+  if( __builtin_cpu_supports("sse2") ) return SSE2;
+#endif
+
+  return Scalar;
+}
+
+
+// ---------------------------------------------------------------
+TString CutKernel::name(InstructionSet is) {
+  if( is == AVX2 ) return "AVX2";
+  if( is == SSE2 ) return "SSE2";
+  return "scalar";
+}
+
+
+// ---------------------------------------------------------------
+void CutKernel::select(InstructionSet is) {
+  if( is > best() ) is = best();
+
+  instructionSet_ = is;
+  greaterThan_ = scalar<GT>;
+  greaterEqualThan_ = scalar<GE>;
+  lessThan_ = scalar<LT>;
+  lessEqualThan_ = scalar<LE>;
+  equal_ = scalar<EQ>;
+  notEqual_ = scalar<NE>;
+  lessThanLessThan_ = scalarRange<GT,LT>;
+  lessEqualThanLessEqualThan_ = scalarRange<GE,LE>;
+#ifdef CUT_KERNEL_X86
+  if( is == SSE2 ) {
+    greaterThan_ = sse2<GT>;
+    greaterEqualThan_ = sse2<GE>;
+    lessThan_ = sse2<LT>;
+    lessEqualThan_ = sse2<LE>;
+    equal_ = sse2<EQ>;
+    notEqual_ = sse2<NE>;
+    lessThanLessThan_ = sse2Range<GT,LT>;
+    lessEqualThanLessEqualThan_ = sse2Range<GE,LE>;
+  } else if( is == AVX2 ) {
+    greaterThan_ = avx2<GT>;
+    greaterEqualThan_ = avx2<GE>;
+    lessThan_ = avx2<LT>;
+    lessEqualThan_ = avx2<LE>;
+    equal_ = avx2<EQ>;
+    notEqual_ = avx2<NE>;
+    lessThanLessThan_ = avx2Range<GT,LT>;
+    lessEqualThanLessEqualThan_ = avx2Range<GE,LE>;
+  }
+#endif
+  isInit_ = true;
+}
@@ -0,0 +1,58 @@
+#ifndef CUT_KERNEL_H
+#define CUT_KERNEL_H
+
+#include "TString.h"
+
+
+// Batch versions of the comparisons of the Cut classes. Each kernel
+// compares a contiguous array of 'n' values (e.g. a block of an
+// EventStore column) and sets mask[i] to 1 if value i passes and to
+// 0 otherwise. The kernels use SSE2 or AVX2 compares if supported by
+// the CPU; the instruction set is chosen at runtime, with a scalar
+// fallback.
+class CutKernel {
+public:
+  enum InstructionSet { Scalar, SSE2, AVX2 };
+
+  static InstructionSet best();
+  static InstructionSet instructionSet() { init(); return instructionSet_; }
+  static TString name(InstructionSet is);
+  // Overwrite the automatically chosen instruction set, e.g. for
+  // benchmarking. Falls back to the best supported one.
+  static void select(InstructionSet is);
+
+  // x > val
+  static void greaterThan(const double* x, unsigned int n, double val, unsigned char* mask) { init(); greaterThan_(x,n,val,0.,mask); }
+  // x >= val
+  static void greaterEqualThan(const double* x, unsigned int n, double val, unsigned char* mask) { init(); greaterEqualThan_(x,n,val,0.,mask); }
+  // x < val
+  static void lessThan(const double* x, unsigned int n, double val, unsigned char* mask) { init(); lessThan_(x,n,val,0.,mask); }
+  // x <= val
+  static void lessEqualThan(const double* x, unsigned int n, double val, unsigned char* mask) { init(); lessEqualThan_(x,n,val,0.,mask); }
+  // x == val
+  static void equal(const double* x, unsigned int n, double val, unsigned char* mask) { init(); equal_(x,n,val,0.,mask); }
+  // x != val
+  static void notEqual(const double* x, unsigned int n, double val, unsigned char* mask) { init(); notEqual_(x,n,val,0.,mask); }
+  // val1 < x < val2
+  static void lessThanLessThan(const double* x, unsigned int n, double val1, double val2, unsigned char* mask) { init(); lessThanLessThan_(x,n,val1,val2,mask); }
+  // val1 <= x <= val2
+  static void lessEqualThanLessEqualThan(const double* x, unsigned int n, double val1, double val2, unsigned char* mask) { init(); lessEqualThanLessEqualThan_(x,n,val1,val2,mask); }
+
+
+private:
+  typedef void (*Kernel)(const double* x, unsigned int n, double val1, double val2, unsigned char* mask);
+
+  static bool isInit_;
+  static InstructionSet instructionSet_;
+  static Kernel greaterThan_;
+  static Kernel greaterEqualThan_;
+  static Kernel lessThan_;
+  static Kernel lessEqualThan_;
+  static Kernel equal_;
+  static Kernel notEqual_;
+  static Kernel lessThanLessThan_;
+  static Kernel lessEqualThanLessEqualThan_;
+
+  static void init() { if( !isInit_ ) select(best()); }
+};
+#endif
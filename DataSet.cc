@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
@@ -6,72 +7,65 @@
 #include "DataSet.h"
 #include "EventBuilder.h"
 #include "GlobalParameters.h"
+#include "Profiler.h"
 #include "Variable.h"
 
 
-DataSetUidMap DataSet::dataSetUidMap_;
+std::map<TString,unsigned int> DataSet::ids_;
+std::vector< std::vector<const DataSet*> > DataSet::dataSets_;
+std::vector<const DataSet*> DataSet::unselected_;
+std::vector<unsigned int> DataSet::order_;
 bool DataSet::isInit_ = false;
+std::vector<DataSet*> DataSet::streamed_;
 
 
 TString DataSet::uid(const TString &label, const TString &selectionUid) {
   return label+":"+selectionUid;
 }
 
-TString DataSet::uid(const TString &label, const Selection* selection) {
-  return uid(label,selection->uid());
-}
 
 const DataSet* DataSet::find(const TString &label, const Selection* selection) {
-  return find(uid(label,selection));
-}
-
-const DataSet* DataSet::find(const TString &uid) {
-  DataSetUidIt it = dataSetUidMap_.find(uid);
-  if( it == dataSetUidMap_.end() ) {
-    std::cerr << "ERROR: DataSet with uid '" << uid << "' does not exist" << std::endl;
+  std::map<TString,unsigned int>::const_iterator it = ids_.find(label);
+  if( it == ids_.end() ) {
+    std::cerr << "ERROR: DataSet with uid '" << uid(label,selection->uid()) << "' does not exist" << std::endl;
     exit(-1);
   }
   
-  return it->second;
+  return dataSets_[it->second][selection->id()];
 }
 
 
-DataSets DataSet::findAllWithSelection(const TString &selectionUid) {
+DataSets DataSet::findAllUnselected() {
   DataSets dataSets;
-  for(DataSetUidIt it = dataSetUidMap_.begin(); it != dataSetUidMap_.end(); ++it) {
-    if( it->second->selectionUid() == selectionUid ) {
-      dataSets.push_back(it->second);
-    }
+  for(std::vector<unsigned int>::const_iterator it = order_.begin(); it != order_.end(); ++it) {
+    dataSets.push_back(unselected_[*it]);
   }
 
   return dataSets;
 }
 
-DataSets DataSet::findAllWithLabel(const TString &label) {
+
+DataSets DataSet::findAllWithSelection(const Selection* selection) {
   DataSets dataSets;
-  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-    dataSets.push_back(find(label,*its));
+  for(std::vector<unsigned int>::const_iterator it = order_.begin(); it != order_.end(); ++it) {
+    dataSets.push_back(dataSets_[*it][selection->id()]);
   }
 
   return dataSets;
 }
 
+DataSets DataSet::findAllWithLabel(const TString &label) {
+  DataSets dataSets;
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    dataSets.push_back(find(label,*its));
+  }
 
-bool DataSet::uidExists(const TString &uid) {
-  return dataSetUidMap_.find(uid) != DataSet::dataSetUidMap_.end();
+  return dataSets;
 }
 
 
 bool DataSet::labelExists(const TString &label) {
-  bool exists = false;
-  for(DataSetUidIt it = dataSetUidMap_.begin(); it != dataSetUidMap_.end(); ++it) {
-    if( it->second->label() = label ) {
-      exists = true;
-      break;
-    }
-  }
-
-  return exists;
+  return ids_.find(label) != ids_.end();
 }
 
 DataSet::Type DataSet::toType(const TString &type) {
@@ -103,11 +97,21 @@ TString DataSet::toString(Type type) {
 
 
 void DataSet::init(const Config &cfg, const TString key) {
+  Profiler::Timer timer("DataSet::init");
   if( isInit_ ) {
     std::cerr << "WARNING: Datasets already initialized. Skipping." << std::endl;
   } else {
     std::cout << "  Reading datasets and applying selections...  " << std::flush;
 
+    // The input files of all datasets are read in one go (possibly
+    // in parallel) after parsing the config. Remember for each
+    // dataset its parameters and its first job.
+    std::vector<EventBuilder::Job> jobs;
+    std::vector<unsigned int> firstJob;
+    std::vector<Type> types;
+    std::vector<TString> labels;
+    std::vector< std::vector<TString> > uncLabels;
+
     std::vector<Config::Attributes> attrList = cfg(key);
     for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
 	it != attrList.end(); ++it) {
@@ -233,14 +237,13 @@ void DataSet::init(const Config &cfg, const TString key) {
 	  }
 	}
 
-	// Create basic (unselected) dataset and
-	// store it in global map of datasets
-	DataSet* basicDataSet = new DataSet(DataSet::toType(type),label,files,tree,weight,uncDn,uncUp,uncLabel,scales);
-	dataSetUidMap_[basicDataSet->uid()] = basicDataSet;
-
-	// Fancy output
-	if( attrList.size() > 3 && it == attrList.begin()+2 ) {
-	  std::cout << "  wait for it...  " << std::flush;
+	// Schedule reading of the input files
+	firstJob.push_back(jobs.size());
+	types.push_back(DataSet::toType(type));
+	labels.push_back(label);
+	uncLabels.push_back(uncLabel);
+	for(unsigned int i = 0; i < files.size(); ++i) {
+	  jobs.push_back(EventBuilder::Job(files.at(i),tree,weight,uncDn,uncUp,uncLabel,scales.at(i)));
 	}
 
       } else {
@@ -251,6 +254,48 @@ void DataSet::init(const Config &cfg, const TString key) {
 	exit(-1);
       }
     }
+
+    // Read events from trees. In streaming mode, the events
+    // are read later, see stream().
+    const bool isStreamed = GlobalParameters::chunkSize() > 0;
+    if( !isStreamed ) {
+      EventBuilder ebd(GlobalParameters::cacheDir(),GlobalParameters::bulkRead(),GlobalParameters::treeCacheSize(),GlobalParameters::prefetch());
+      ebd(jobs,GlobalParameters::nThreads());
+    }
+
+    for(unsigned int ds = 0; ds < labels.size(); ++ds) {
+      // Merge the events of all files of this dataset into
+      // the store of the first file, keeping the file order
+      unsigned int lastJob = ds+1 < firstJob.size() ? firstJob.at(ds+1) : jobs.size();
+      EventStore* store = jobs.at(firstJob.at(ds)).store_;
+      for(unsigned int j = firstJob.at(ds)+1; j < lastJob; ++j) {
+	store->append(*(jobs.at(j).store_));
+	delete jobs.at(j).store_;
+      }
+
+      // Create basic (unselected) dataset and
+      // store it in global map of datasets
+      DataSet* basicDataSet = new DataSet(types.at(ds),labels.at(ds),uncLabels.at(ds),store);
+      if( isStreamed ) {
+	for(unsigned int j = firstJob.at(ds); j < lastJob; ++j) {
+	  basicDataSet->inputs_.push_back(jobs.at(j));
+	  basicDataSet->inputs_.back().store_ = 0;
+	}
+	streamed_.push_back(basicDataSet);
+      }
+
+      // Fancy output
+      if( labels.size() > 3 && ds == 2 ) {
+	std::cout << "  wait for it...  " << std::flush;
+      }
+    }
+
+    // List the datasets in the order of their uids
+    for(unsigned int id = 0; id < unselected_.size(); ++id) {
+      order_.push_back(id);
+    }
+    std::sort(order_.begin(),order_.end(),DataSet::uidLessThan);
+
     isInit_ = true;
     std::cout << "ok" << std::endl;
   }
@@ -258,22 +303,28 @@ void DataSet::init(const Config &cfg, const TString key) {
 
 
 void DataSet::clear() {
-  for(std::map<TString,const DataSet*>::iterator it = dataSetUidMap_.begin();
-      it != dataSetUidMap_.end(); ++it) {
-    delete it->second;
+  for(unsigned int id = 0; id < unselected_.size(); ++id) {
+    for(unsigned int sel = 0; sel < dataSets_[id].size(); ++sel) {
+      if( dataSets_[id][sel] != unselected_[id] ) delete dataSets_[id][sel];
+    }
+    delete unselected_[id];
   }
+  ids_.clear();
+  dataSets_.clear();
+  unselected_.clear();
+  order_.clear();
 }
 
 
-DataSet::DataSet(Type type, const TString &label, const std::vector<TString> &fileNames, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, const std::vector<double> &scales)
-  : hasMother_(false), type_(type), label_(label), selectionUid_("unselected") {
+DataSet::DataSet(Type type, const TString &label, const std::vector<TString> &uncLabel, EventStore* store)
+  : id_(unselected_.size()), hasMother_(false), type_(type), label_(label), selectionUid_("unselected"), store_(store), nEvts_(0) {
   if( GlobalParameters::debug() ) {
     std::cout << "DEBUG: Entering DataSet::DataSet()" << std::endl;
     std::cout << "       Creating DataSet '" << label << "'" << std::endl;
   }
 
   // Sanity checks
-  if( uidExists(uid()) ) {
+  if( labelExists(label) ) {
     std::cerr << "\n\nERROR in DataSet::DataSet(): a dataset with label '" << label << "' already exists.\n\n\n" << std::endl;
     exit(-1);
   }
@@ -292,28 +343,30 @@ DataSet::DataSet(Type type, const TString &label, const std::vector<TString> &fi
     }
   }
 
-  // Read events from tree
-  EventBuilder ebd;
-  std::vector<TString>::const_iterator fileIt = fileNames.begin();
-  std::vector<double>::const_iterator scaleIt = scales.begin();
-  for(; fileIt != fileNames.end(); ++fileIt, ++scaleIt) {
-    Events evts = ebd(*fileIt,treeName,weight,uncDn,uncUp,uncLabel,*scaleIt);
-    evts_.insert(evts_.end(),evts.begin(),evts.end());
-  }
+  // Register this dataset; the slot of the 'unselected'
+  // selection refers to this dataset
+  ids_[label] = id_;
+  unselected_.push_back(this);
+  dataSets_.push_back(std::vector<const DataSet*>(Selection::end()-Selection::begin(),this));
 
   // Compute yield and uncertainties
   computeYield(uncLabel);
 
-  // Create selected datasets
+  // Apply all selections, each as compiled program on blocks of events
+  std::vector<const Selection*> selections;
   for(SelectionIt selIt = Selection::begin();
       selIt != Selection::end(); ++selIt) {
-
-    if( (*selIt)->uid() != "unselected" ) {
-      // Create selected dataset and store it
-      // in global map of datasets
-      DataSet* selectedDataSet = new DataSet(this,(*selIt)->uid(),applySelection(*selIt));
-      dataSetUidMap_[selectedDataSet->uid()] = selectedDataSet;
-    }
+    if( (*selIt)->uid() != "unselected" ) selections.push_back(*selIt);
+  }
+  std::vector<EventMask> masks;
+  applySelections(selections,masks);
+
+  // Create selected datasets and store them
+  // in global map of datasets
+  for(unsigned int i = 0; i < selections.size(); ++i) {
+    DataSet* selectedDataSet = new DataSet(this,selections[i]->uid(),masks[i]);
+    dataSets_[id_][selections[i]->id()] = selectedDataSet;
+    selectedDataSets_.push_back(selectedDataSet);
   }
 
 
@@ -323,9 +376,14 @@ DataSet::DataSet(Type type, const TString &label, const std::vector<TString> &fi
 }
 
 
-DataSet::DataSet(const DataSet *ds, const TString &selectionUid, const Events &evts)
-  : hasMother_(true), type_(ds->type()), label_(ds->label()), selectionUid_(selectionUid) {
-  if( uidExists(uid()) ) {
+DataSet::DataSet(const DataSet *ds, const TString &selectionUid, const EventMask &mask)
+  : id_(ds->id_), hasMother_(true), type_(ds->type()), label_(ds->label()), selectionUid_(selectionUid), store_(ds->store_), mask_(mask), nEvts_(0) {
+  bool exists = false;
+  for(std::vector<DataSet*>::const_iterator it = ds->selectedDataSets_.begin();
+      it != ds->selectedDataSets_.end(); ++it) {
+    if( (*it)->selectionUid() == selectionUid ) exists = true;
+  }
+  if( exists ) {
     std::cerr << "\n\nERROR in DataSet::DataSet(): a dataset with label '" << label_ << "' and selection '" << selectionUid_ << "' already exists." << std::endl;
     exit(-1);
   }
@@ -337,11 +395,6 @@ DataSet::DataSet(const DataSet *ds, const TString &selectionUid, const Events &e
     uncLabels.push_back(*it);
   }
   
-  // Store events
-  for(EventIt it = evts.begin(); it != evts.end(); ++it) {
-    evts_.push_back(*it);
-  }
-
   // Compute yield and uncertainties
   computeYield(uncLabels);
 }
@@ -349,11 +402,115 @@ DataSet::DataSet(const DataSet *ds, const TString &selectionUid, const Events &e
 
 DataSet::~DataSet() {
   if( !hasMother_ ) {
-    for(Events::iterator it = evts_.begin(); it != evts_.end(); ++it) {
-      delete *it;
+    delete store_;
+  }
+}
+
+
+// Masks of the events that pass each of the selections. All
+// selections are run on one block of events before the next, such
+// that filters shared between them are evaluated once per block.
+// ---------------------------------------------------------------
+void DataSet::applySelections(const std::vector<const Selection*> &selections, std::vector<EventMask> &masks) const {
+  Profiler::Timer timer("Selection::apply");
+  masks = std::vector<EventMask>(selections.size(),EventMask(store_->size()));
+
+  // Refined selections are evaluated on the events of their parent
+  std::vector<const FilterProgram*> programs(selections.size(),0);
+  std::vector<const EventMask*> parentMasks(selections.size(),0);
+  for(unsigned int i = 0; i < selections.size(); ++i) {
+    for(unsigned int j = 0; j < i; ++j) {
+      if( selections[j] == selections[i]->parent(label_) ) parentMasks[i] = &(masks[j]);
+    }
+    programs[i] = &(selections[i]->program(label_,parentMasks[i] != 0));
+  }
+
+  // In the adaptive mode, the first events of the first non-empty
+  // store are sampled, and then the programs are reordered in place
+  FilterProgram::Memo memo;
+  for(unsigned int begin = 0; begin < store_->size(); begin += FilterProgram::blockSize_) {
+    if( begin == FilterProgram::nSamples_ && FilterProgram::isSampling() ) Selection::reorder();
+    const unsigned int end = std::min(begin+FilterProgram::blockSize_,store_->size());
+    for(unsigned int i = 0; i < selections.size(); ++i) {
+      programs[i]->run(*store_,begin,end,masks[i],parentMasks[i],&memo);
+    }
+  }
+  if( FilterProgram::isSampling() && store_->size() > 0 ) Selection::reorder();
+  Profiler::count("Selection::apply","entries",store_->size());
+}
+
+
+// Replaces the events of this (unselected) dataset and of its
+// selected datasets by the events in 'store'
+// ---------------------------------------------------------------
+void DataSet::setEvents(EventStore* store) {
+  delete store_;
+  store_ = store;
+  std::vector<const Selection*> selections;
+  for(std::vector<DataSet*>::const_iterator it = selectedDataSets_.begin();
+      it != selectedDataSets_.end(); ++it) {
+    selections.push_back(Selection::find((*it)->selectionUid()));
+  }
+  std::vector<EventMask> masks;
+  applySelections(selections,masks);
+  for(unsigned int i = 0; i < selectedDataSets_.size(); ++i) {
+    selectedDataSets_[i]->store_ = store_;
+    selectedDataSets_[i]->mask_ = masks[i];
+  }
+}
+
+
+// Reads the input files of each dataset in chunks of
+// GlobalParameters::chunkSize() events. Each chunk is passed to
+// the consumers, its yields are added, and then it is deleted.
+// ---------------------------------------------------------------
+void DataSet::stream(const std::vector<EventConsumer*> &consumers) {
+  if( streamed_.size() == 0 ) return;
+  Profiler::Timer timer("DataSet::stream");
+
+  std::cout << "  Streaming events in chunks of " << GlobalParameters::chunkSize() << "...  " << std::flush;
+  const EventBuilder ebd("",GlobalParameters::bulkRead(),GlobalParameters::treeCacheSize());
+  for(std::vector<DataSet*>::const_iterator itd = streamed_.begin();
+      itd != streamed_.end(); ++itd) {
+    DataSet* ds = *itd;
+    const std::vector<TString> uncLabels = ds->systLabels_;
+    std::vector<DataSet*> dataSets(1,ds);
+    dataSets.insert(dataSets.end(),ds->selectedDataSets_.begin(),ds->selectedDataSets_.end());
+    for(std::vector<DataSet*>::const_iterator it = dataSets.begin(); it != dataSets.end(); ++it) {
+      (*it)->resetYield(uncLabels);
+    }
+
+    for(std::vector<EventBuilder::Job>::const_iterator itj = ds->inputs_.begin();
+	itj != ds->inputs_.end(); ++itj) {
+      // Read ahead the next input file meanwhile
+      const EventBuilder::Job* next = 0;
+      if( itj+1 != ds->inputs_.end() ) next = &(*(itj+1));
+      else if( itd+1 != streamed_.end() && (*(itd+1))->inputs_.size() > 0 ) next = &((*(itd+1))->inputs_.front());
+      const EventBuilder::Prefetcher prefetcher(GlobalParameters::prefetch() ? next : 0);
+      unsigned int nEntries = 0;
+      unsigned int first = 0;
+      do {
+	EventStore* chunk = new EventStore(itj->uncLabel_);
+	nEntries = ebd(itj->fileName_,itj->treeName_,itj->weight_,itj->uncDn_,itj->uncUp_,itj->uncLabel_,itj->scale_,*chunk,first,GlobalParameters::chunkSize());
+	ds->setEvents(chunk);
+	for(std::vector<DataSet*>::const_iterator it = dataSets.begin(); it != dataSets.end(); ++it) {
+	  (*it)->addYield();
+	  for(std::vector<EventConsumer*>::const_iterator itc = consumers.begin();
+	      itc != consumers.end(); ++itc) {
+	    (*itc)->process(*it);
+	  }
+	}
+	first += GlobalParameters::chunkSize();
+      } while( first < nEntries );
+    }
+
+    // Free the last chunk
+    ds->setEvents(new EventStore(uncLabels));
+    for(std::vector<DataSet*>::const_iterator it = dataSets.begin(); it != dataSets.end(); ++it) {
+      (*it)->finishYield();
     }
   }
-  evts_.clear();
+  std::cout << "ok" << std::endl;
 }
 
 
@@ -365,54 +522,130 @@ void DataSet::computeYield(const std::vector<TString> &uncLabel) {
     std::cout << "       Computing yields and uncertainties for '" << uid() << "'" << std::endl;
   }
 
-  // Set all uncertainty variables to zero
-  yield_  = 0.;
-  stat_   = 0.;
-  totSystDn_ = 0.;
-  totSystUp_ = 0.;
-  systDn_.clear();
-  systUp_.clear();
-  for(std::vector<TString>::const_iterator it = systLabelsBegin();
-      it != systLabelsEnd(); ++it) {
-    systDn_[*it] = 0.;
-    systUp_[*it] = 0.;
+  resetYield(uncLabel);
+  addYield();
+  finishYield();
+
+  if( GlobalParameters::debug() ) {
+    std::cout << "DEBUG: Leaving DataSet::computeYield()" << std::endl;
   }
-  systLabels_.clear();
+}
 
-  // Copy uncertainty labels
-  for(std::vector<TString>::const_iterator it = uncLabel.begin();
-      it != uncLabel.end(); ++it) {
-    systLabels_.push_back(*it);
+
+// ---------------------------------------------------------------
+void DataSet::resetYield(const std::vector<TString> &uncLabel) {
+  // Copy uncertainty labels; they are referred to by their
+  // index in the following
+  systLabels_ = uncLabel;
+
+  // Set all sums to zero
+  nEvts_  = 0;
+  sums_ = std::vector<Sum>(4+2*systLabels_.size());
+}
+
+
+// Sum of x[i]*y[i] for i < n, or of x[i] if y is 0. Uses four
+// independent partial sums, which do not depend on each other and
+// can be computed in parallel by the CPU.
+// ---------------------------------------------------------------
+double DataSet::sumOfProducts(const double* x, const double* y, unsigned int n, bool compensated) {
+  Sum sums[4];
+  const unsigned int n4 = n - n%4;
+  for(unsigned int i = 0; i < n4; i += 4) {
+    for(unsigned int l = 0; l < 4; ++l) {
+      sums[l].add(y ? x[i+l]*y[i+l] : x[i+l],compensated);
+    }
   }
-  
-  // Loop over events and count yield (sum of event weights)
-  // for nominal and varied weights
-  for(EventIt evtIt = evts_.begin(); evtIt != evts_.end(); ++evtIt) {
-    yield_ += (*evtIt)->weight();
-    stat_  += pow((*evtIt)->weight(),2.);
-    if( (*evtIt)->hasUnc() ) {
-      totSystDn_ += (*evtIt)->weight() * (1.-(*evtIt)->relTotalUncDn());
-      totSystUp_ += (*evtIt)->weight() * (1.+(*evtIt)->relTotalUncUp());
-      for(std::vector<TString>::const_iterator systIt = systLabelsBegin();
-	  systIt != systLabelsEnd(); ++systIt) {
-	systDn_[*systIt] += (*evtIt)->weight() * (1.-(*evtIt)->relUncDn(*systIt));
-	systUp_[*systIt] += (*evtIt)->weight() * (1.+(*evtIt)->relUncUp(*systIt));
+  for(unsigned int i = n4; i < n; ++i) {
+    sums[i-n4].add(y ? x[i]*y[i] : x[i],compensated);
+  }
+
+  return (sums[0].value() + sums[1].value()) + (sums[2].value() + sums[3].value());
+}
+
+
+// Adds the current events to the sums. The weights and the
+// uncertainty columns of the selected events are gathered into
+// contiguous arrays, and each sum is computed in one pass over
+// them.
+// ---------------------------------------------------------------
+void DataSet::addYield() {
+  const bool compensated = GlobalParameters::kahanSummation();
+
+  // Indices of the selected events
+  std::vector<unsigned int> evts;
+  if( hasMother_ ) {
+    evts.reserve(mask_.count());
+    for(unsigned int i = mask_.next(0); i < mask_.size(); i = mask_.next(i+1)) {
+      evts.push_back(i);
+    }
+  }
+  const unsigned int n = hasMother_ ? evts.size() : store_->size();
+  nEvts_ += n;
+  if( n == 0 ) return;
+
+  // Weights of the selected events
+  std::vector<double> w;
+  const double* wPtr = &(store_->weights()[0]);
+  if( hasMother_ ) {
+    w.resize(n);
+    for(unsigned int i = 0; i < n; ++i) {
+      w[i] = wPtr[evts[i]];
+    }
+    wPtr = &w[0];
+  }
+  sums_[0].add(sumOfProducts(wPtr,0,n,compensated),compensated);
+  sums_[1].add(sumOfProducts(wPtr,wPtr,n,compensated),compensated);
+
+  // Weighted uncertainties
+  if( store_->hasUnc() ) {
+    std::vector<const std::vector<double>*> cols;
+    cols.push_back(&(store_->relTotalUncDnColumn()));
+    cols.push_back(&(store_->relTotalUncUpColumn()));
+    for(std::vector<TString>::const_iterator systIt = systLabelsBegin();
+	systIt != systLabelsEnd(); ++systIt) {
+      int unc = store_->uncIdx(*systIt);
+      cols.push_back(unc >= 0 ? &(store_->relUncDnColumn(unc)) : 0);
+      cols.push_back(unc >= 0 ? &(store_->relUncUpColumn(unc)) : 0);
+    }
+    std::vector<double> x;
+    if( hasMother_ ) x.resize(n);
+    for(unsigned int c = 0; c < cols.size(); ++c) {
+      if( cols[c] == 0 ) continue;
+      const double* xPtr = &((*cols[c])[0]);
+      if( hasMother_ ) {
+	for(unsigned int i = 0; i < n; ++i) {
+	  x[i] = xPtr[evts[i]];
+	}
+	xPtr = &x[0];
       }
+      sums_[2+c].add(sumOfProducts(wPtr,xPtr,n,compensated),compensated);
     }
   }
+}
+
+
+// Turns the sums into the yield and uncertainties
+// ---------------------------------------------------------------
+void DataSet::finishYield() {
+  yield_ = sums_[0].value();
+  stat_ = sums_[1].value();
 
   // Set systematic uncertainty
-  if( evts_.size() > 0 && evts_.front()->hasUnc() ) {
+  systDn_ = std::vector<double>(systLabels_.size(),0.);
+  systUp_ = std::vector<double>(systLabels_.size(),0.);
+  if( size() > 0 && store_->hasUnc() ) {
     hasSyst_ = true;
-    totSystDn_ = yield_-totSystDn_;
-    totSystUp_ = totSystUp_-yield_;
-    for(std::vector<TString>::const_iterator systIt = systLabelsBegin();
-	systIt != systLabelsEnd(); ++systIt) {
-      systDn_[*systIt] = yield_ - systDn_[*systIt];
-      systUp_[*systIt] = systUp_[*systIt] - yield_;
-    }    
+    totSystDn_ = sums_[2].value();
+    totSystUp_ = sums_[3].value();
+    for(unsigned int i = 0; i < systLabels_.size(); ++i) {
+      systDn_[i] = sums_[4+2*i].value();
+      systUp_[i] = sums_[5+2*i].value();
+    }
   } else {
     hasSyst_ = false;
+    totSystDn_ = 0.;
+    totSystUp_ = 0.;
   }
 
   // Set statistical uncertainty, depending on dataset type
@@ -427,42 +660,27 @@ void DataSet::computeYield(const std::vector<TString> &uncLabel) {
   } else {
     stat_ = sqrt(stat_);
   }
-
-  if( GlobalParameters::debug() ) {
-    std::cout << "DEBUG: Leaving DataSet::computeYield()" << std::endl;
-  }
 }
 
 
 // ---------------------------------------------------------------
-Events DataSet::applySelection(const Selection* sel) const {
-  Events passed;
-  for(EventIt it = evtsBegin(); it != evtsEnd(); ++it) {
-    if( sel->passes(*it,label()) ) passed.push_back(*it);
-  }
-
-  return passed;
-}
-
-
-
 
 double DataSet::systDn(const TString &label) const {
-  double unc = 0.;
-  std::map<TString,double>::const_iterator it = systDn_.find(label);
-  if( it != systDn_.end() ) {
-    unc = it->second;
-  }
+  int i = systIdx(label);
 
-  return unc;
+  return i >= 0 ? systDn_[i] : 0.;
 }
 
 double DataSet::systUp(const TString &label) const {
-  double unc = 0.;
-  std::map<TString,double>::const_iterator it = systUp_.find(label);
-  if( it != systUp_.end() ) {
-    unc = it->second;
+  int i = systIdx(label);
+
+  return i >= 0 ? systUp_[i] : 0.;
+}
+
+int DataSet::systIdx(const TString &label) const {
+  for(unsigned int i = 0; i < systLabels_.size(); ++i) {
+    if( systLabels_[i] == label ) return i;
   }
-  
-  return unc;
+
+  return -1;
 }
@@ -8,33 +8,33 @@
 
 #include "Config.h"
 #include "Event.h"
+#include "EventBuilder.h"
+#include "EventConsumer.h"
 #include "Selection.h"
 
 class DataSet;
 typedef std::vector<const DataSet*> DataSets;
 typedef std::vector<const DataSet*>::const_iterator DataSetIt;
 typedef std::vector<const DataSet*>::const_reverse_iterator DataSetRIt;
-typedef std::map<TString,const DataSet*> DataSetUidMap;
-typedef std::map<TString,const DataSet*>::const_iterator DataSetUidIt;
 
 class DataSet {
 public:
   enum Type { Data, MC, MCPrediction, Prediction, Signal };
 
   static TString uid(const TString &label, const TString &selectionUid);
-  static TString uid(const TString &label, const Selection* selection);
-  static const DataSet* find(const TString &uid);
   static const DataSet* find(const TString &label, const Selection* selection);
-  static DataSets findAllUnselected() {
-    return findAllWithSelection("unselected");
+  // The dataset with the same label as 'dataSet' and 'selection'
+  static const DataSet* find(const DataSet* dataSet, const Selection* selection) {
+    return dataSets_[dataSet->id_][selection->id()];
   }
-  static DataSets findAllWithSelection(const TString &selectionUid);
+  static DataSets findAllUnselected();
+  static DataSets findAllWithSelection(const Selection* selection);
   static DataSets findAllWithLabel(const TString &label);
-  static DataSetUidIt begin() { return dataSetUidMap_.begin(); }
-  static DataSetUidIt end() { return dataSetUidMap_.end(); }
   static void init(const Config &cfg, const TString key);
+  // In streaming mode, reads the events in chunks and passes each
+  // chunk to the consumers; the yields are accumulated as well
+  static void stream(const std::vector<EventConsumer*> &consumers);
   static void clear();
-  static bool uidExists(const TString &uid);
   static bool labelExists(const TString &label);
   static Type toType(const TString &type);
   static TString toString(Type type);
@@ -47,10 +47,10 @@ public:
   Type type() const { return type_; }
   bool isSimulated() const { return !( type() == Data || type() == Prediction ); }
 
-  EventIt evtsBegin() const { return evts_.begin(); }
-  EventIt evtsEnd() const { return evts_.end(); }
+  EventIt evtsBegin() const { return EventIt(store_,0,maskPtr()); }
+  EventIt evtsEnd() const { return EventIt(store_,store_->size(),maskPtr()); }
 
-  unsigned int size() const { return evts_.size(); }
+  unsigned int size() const { return nEvts_; }
   double yield() const { return yield_; }		// Return weighted number of events
   double stat() const { return stat_; }                 // Return statistical uncertainty on yield
   bool hasSyst() const { return hasSyst_; }
@@ -58,33 +58,91 @@ public:
   double totSystUp() const { return totSystUp_; }
   double systDn(const TString &label) const;
   double systUp(const TString &label) const;
+  double systDn(unsigned int i) const { return systDn_[i]; } // i-th label, see systLabelsBegin()
+  double systUp(unsigned int i) const { return systUp_[i]; }
   unsigned int nSyst() const { return systLabels_.size(); }
   std::vector<TString>::const_iterator systLabelsBegin() const { return systLabels_.begin(); }
   std::vector<TString>::const_iterator systLabelsEnd() const { return systLabels_.end(); }
 
 
 private:
-  static DataSetUidMap dataSetUidMap_;
+  friend class Benchmark;
+
+  // Registry of all datasets. Each dataset label has an id, and the
+  // datasets are stored by (label id, selection id), see Selection::id().
+  // The unselected dataset of a label is stored in addition by
+  // its id. The order is the order of the datasets when listed.
+  static std::map<TString,unsigned int> ids_;
+  static std::vector< std::vector<const DataSet*> > dataSets_;
+  static std::vector<const DataSet*> unselected_;
+  static std::vector<unsigned int> order_;
   static bool isInit_;                 // Datasets can only be initialized once
+  static std::vector<DataSet*> streamed_;	// Unselected datasets in streaming mode
+
+  static bool uidLessThan(unsigned int id1, unsigned int id2) {
+    return unselected_[id1]->uid() < unselected_[id2]->uid();
+  }
 
+  const unsigned int id_;
   const Type type_;
   const TString label_;   // This is the label specified in the config
   const bool hasMother_;
   const TString selectionUid_;
 
-  Events evts_;
+  // The unselected dataset owns the event columns; the selected
+  // datasets refer to them via a mask of the selected events.
+  // In streaming mode, these are the events of the current chunk.
+  EventStore* store_;
+  EventMask mask_;
+  std::vector<DataSet*> selectedDataSets_;
+  std::vector<EventBuilder::Job> inputs_;	// Streaming mode only
+  unsigned int nEvts_;
   double yield_;
   double stat_;
   bool hasSyst_;
   double totSystDn_;
   double totSystUp_;
   std::vector<TString> systLabels_;
-  std::map<TString,double> systDn_;
-  std::map<TString,double> systUp_;
+  std::vector<double> systDn_;	// Per label, same order as systLabels_
+  std::vector<double> systUp_;
+
+  // Sum of values, optionally with Kahan compensation
+  class Sum {
+  public:
+    Sum() : sum_(0.), comp_(0.) {};
+
+    void add(double x, bool compensated) {
+      if( compensated ) {
+	const double y = x - comp_;
+	const double t = sum_ + y;
+	comp_ = (t - sum_) - y;
+	sum_ = t;
+      } else {
+	sum_ += x;
+      }
+    }
+    double value() const { return sum_ - comp_; }
+
+  private:
+    double sum_;
+    double comp_;
+  };
+
+  // Running sums while the yield is computed: weights, squared
+  // weights, weighted total dn and up uncertainties, and weighted
+  // dn and up uncertainties per label
+  std::vector<Sum> sums_;
 
-  DataSet(Type type, const TString &label, const std::vector<TString> &fileNames, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, const std::vector<double> &scales);
-  DataSet(const DataSet *ds, const TString &selectionUid, const Events &evts);
+  DataSet(Type type, const TString &label, const std::vector<TString> &uncLabel, EventStore* store);
+  DataSet(const DataSet *ds, const TString &selectionUid, const EventMask &mask);
+  const EventMask* maskPtr() const { return hasMother_ ? &mask_ : 0; }
+  void applySelections(const std::vector<const Selection*> &selections, std::vector<EventMask> &masks) const;
+  void setEvents(EventStore* store);
   void computeYield(const std::vector<TString> &uncLabel);
-  Events applySelection(const Selection* sel) const;
+  void resetYield(const std::vector<TString> &uncLabel);
+  void addYield();
+  void finishYield();
+  static double sumOfProducts(const double* x, const double* y, unsigned int n, bool compensated);
+  int systIdx(const TString &label) const;
 };
 #endif
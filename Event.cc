@@ -5,41 +5,36 @@
 #include "Variable.h"
 
 
-std::map<TString,unsigned int> Event::varIdx_;
+double Event::get(const TString &var) const {
+  return store_->get(Variable::index(var),idx_);
+}
 
 
-Event::Event()
-  : weight_(1.), relTotalUncDn_(0.), relTotalUncUp_(0.) {
-  init();
+double Event::weight() const {
+  return store_->weight(idx_);
 }
 
-Event::Event(double weight)
-  : weight_(weight), relTotalUncDn_(0.), relTotalUncUp_(0.) {
-  init();
+
+bool Event::hasUnc() const {
+  return store_->hasUnc();
 }
 
-void Event::init() {
-  Variable::checkIfIsInit();
-  if( varIdx_.size() == 0 ) {
-    for(std::vector<TString>::const_iterator it = Variable::begin();
-	it != Variable::end(); ++it) {
-      varIdx_[*it] = varIdx_.size()-1;
-    }
-  }
-  vars_ = std::vector<double>(varIdx_.size());
+
+double Event::relTotalUncDn() const {
+  return store_->hasUnc() ? store_->relTotalUncDn(idx_) : 0.;
 }
 
 
-void Event::set(const TString &var, double val) {
-  vars_.at(varIdx_.find(var)->second) = val;
+double Event::relTotalUncUp() const {
+  return store_->hasUnc() ? store_->relTotalUncUp(idx_) : 0.;
 }
 
 
 double Event::relUncDn(const TString &label) const {
   double unc = 0.;
-  std::map<TString,double>::const_iterator it = relUncDn_.find(label);
-  if( it != relUncDn_.end() ) {
-    unc = it->second;
+  int uncIdx = store_->uncIdx(label);
+  if( uncIdx >= 0 ) {
+    unc = store_->relUncDn(uncIdx,idx_);
   }
 
   return unc;
@@ -48,25 +43,117 @@ double Event::relUncDn(const TString &label) const {
 
 double Event::relUncUp(const TString &label) const {
   double unc = 0.;
-  std::map<TString,double>::const_iterator it = relUncUp_.find(label);
-  if( it != relUncUp_.end() ) {
-    unc = it->second;
+  int uncIdx = store_->uncIdx(label);
+  if( uncIdx >= 0 ) {
+    unc = store_->relUncUp(uncIdx,idx_);
   }
 
   return unc;
 }
 
 
-void Event::addRelUnc(double dn, double up, const TString &label) {
-  if( relUncDn_.find(label) == relUncDn_.end() &&
-      relUncUp_.find(label) == relUncUp_.end()    ) { 
-    // Add to list of uncertainties
-    relUncDn_[label] = dn;
-    relUncUp_[label] = up;
-    // Recompute total uncertainty
-    // (quadratic sum of all uncertainties)
-    relTotalUncDn_ = sqrt( relTotalUncDn_*relTotalUncDn_ + dn*dn );
-    relTotalUncUp_ = sqrt( relTotalUncUp_*relTotalUncUp_ + up*up );
+
+// ---------------------------------------------------------------
+EventStore::EventStore(const std::vector<TString> &uncLabels)
+  : uncLabels_(uncLabels) {
+  Variable::checkIfIsInit();
+  vars_ = std::vector< std::vector<double> >(Variable::nVars());
+  relUncDn_ = std::vector< std::vector<double> >(uncLabels_.size());
+  relUncUp_ = std::vector< std::vector<double> >(uncLabels_.size());
+}
+
+
+void EventStore::reserve(unsigned int n) {
+  for(unsigned int var = 0; var < vars_.size(); ++var) {
+    if( Variable::isUsed(var) ) vars_.at(var).reserve(n);
+  }
+  weight_.reserve(n);
+  if( hasUnc() ) {
+    relTotalUncDn_.reserve(n);
+    relTotalUncUp_.reserve(n);
+    for(unsigned int i = 0; i < nUnc(); ++i) {
+      relUncDn_.at(i).reserve(n);
+      relUncUp_.at(i).reserve(n);
+    }
+  }
+}
+
+
+// Append all events of 'store', which is expected to have the
+// same layout (variables and uncertainty labels)
+void EventStore::append(const EventStore &store) {
+  reserve(size()+store.size());
+  for(unsigned int v = 0; v < nVars(); ++v) {
+    vars_.at(v).insert(vars_.at(v).end(),store.vars_.at(v).begin(),store.vars_.at(v).end());
+  }
+  weight_.insert(weight_.end(),store.weight_.begin(),store.weight_.end());
+  relTotalUncDn_.insert(relTotalUncDn_.end(),store.relTotalUncDn_.begin(),store.relTotalUncDn_.end());
+  relTotalUncUp_.insert(relTotalUncUp_.end(),store.relTotalUncUp_.begin(),store.relTotalUncUp_.end());
+  for(unsigned int i = 0; i < nUnc(); ++i) {
+    relUncDn_.at(i).insert(relUncDn_.at(i).end(),store.relUncDn_.at(i).begin(),store.relUncDn_.at(i).end());
+    relUncUp_.at(i).insert(relUncUp_.at(i).end(),store.relUncUp_.at(i).begin(),store.relUncUp_.at(i).end());
   }
 }
 
+
+// Append event 'evt' of 'store', which is expected to have
+// the same layout
+void EventStore::append(const EventStore &store, unsigned int evt) {
+  for(unsigned int v = 0; v < nVars(); ++v) {
+    if( Variable::isUsed(v) ) vars_.at(v).push_back(store.vars_.at(v).at(evt));
+  }
+  weight_.push_back(store.weight_.at(evt));
+  if( hasUnc() ) {
+    relTotalUncDn_.push_back(store.relTotalUncDn_.at(evt));
+    relTotalUncUp_.push_back(store.relTotalUncUp_.at(evt));
+    for(unsigned int i = 0; i < nUnc(); ++i) {
+      relUncDn_.at(i).push_back(store.relUncDn_.at(i).at(evt));
+      relUncUp_.at(i).push_back(store.relUncUp_.at(i).at(evt));
+    }
+  }
+}
+
+
+int EventStore::uncIdx(const TString &label) const {
+  for(unsigned int i = 0; i < uncLabels_.size(); ++i) {
+    if( uncLabels_[i] == label ) return i;
+  }
+
+  return -1;
+}
+
+
+// Add the uncertainty 'unc' of the last event. The uncertainties
+// have to be added in the order of the labels. The total
+// uncertainty is the quadratic sum of all uncertainties.
+void EventStore::addRelUnc(unsigned int unc, double dn, double up) {
+  relUncDn_.at(unc).push_back(dn);
+  relUncUp_.at(unc).push_back(up);
+  if( unc == 0 ) {
+    relTotalUncDn_.push_back(std::abs(dn));
+    relTotalUncUp_.push_back(std::abs(up));
+  } else {
+    double &totDn = relTotalUncDn_.back();
+    double &totUp = relTotalUncUp_.back();
+    totDn = sqrt( totDn*totDn + dn*dn );
+    totUp = sqrt( totUp*totUp + up*up );
+  }
+}
+
+
+
+// ---------------------------------------------------------------
+unsigned int EventMask::next(unsigned int evt) const {
+  if( evt >= size_ ) return size_;
+
+  // Skip empty words and find lowest set bit
+  unsigned int w = evt/32;
+  unsigned int word = words_[w] & (~0u << (evt%32));
+  while( word == 0 ) {
+    ++w;
+    if( w >= words_.size() ) return size_;
+    word = words_[w];
+  }
+
+  return 32*w + __builtin_ctz(word);
+}
@@ -1,45 +1,141 @@
 #ifndef EVENT_H
 #define EVENT_H
 
-#include <map>
 #include <vector>
 
 #include "TString.h"
 
-class Event {
-  friend class EventBuilder;
+class EventStore;
 
+
+// Lightweight handle to one event (one row) of an EventStore.
+// Events are not allocated individually; they are views on the
+// columns owned by the (unselected) DataSet.
+class Event {
 public:
-  ~Event() {};
+  Event() : store_(0), idx_(0) {};
+  Event(const EventStore* store, unsigned int idx) : store_(store), idx_(idx) {};
 
-  double get(const TString &var) const { return vars_.at(varIdx_.find(var)->second); }
-  double weight() const { return weight_; }
-  bool hasUnc() const { return relUncDn_.size() > 0; }
+  double get(unsigned int var) const;
+  double get(const TString &var) const;
+  double weight() const;
+  bool hasUnc() const;
   double weightUncDn() const { return weight()*(1.-relTotalUncDn()); };
   double weightUncUp() const { return weight()*(1.+relTotalUncUp()); };
-  double relTotalUncDn() const { return relTotalUncDn_; };
-  double relTotalUncUp() const { return relTotalUncUp_; };
+  double relTotalUncDn() const;
+  double relTotalUncUp() const;
   double relUncDn(const TString &label) const;
   double relUncUp(const TString &label) const;
-  
+
+  const EventStore* store() const { return store_; }
+  unsigned int index() const { return idx_; }
+  bool operator==(const Event &evt) const { return store_ == evt.store_ && idx_ == evt.idx_; }
+  bool operator!=(const Event &evt) const { return !(*this == evt); }
+
+private:
+  const EventStore* store_;
+  unsigned int idx_;
+};
+
+
+// Columnar (struct-of-arrays) storage of events: one contiguous
+// array per Variable plus the weight and uncertainty columns.
+// The columns of variables that are not used (see Variable::use())
+// are empty.
+// The uncertainty labels are the same for all events of a store.
+class EventStore {
+  friend class EventBuilder;
+  friend class EventCache;
+
+public:
+  EventStore(const std::vector<TString> &uncLabels);
+
+  unsigned int size() const { return weight_.size(); }
+  unsigned int nVars() const { return vars_.size(); }
+  void reserve(unsigned int n);
+  void append(const EventStore &store);
+  void append(const EventStore &store, unsigned int evt);
+
+  double get(unsigned int var, unsigned int evt) const { return vars_[var][evt]; }
+  const std::vector<double>& column(unsigned int var) const { return vars_.at(var); }
+  double weight(unsigned int evt) const { return weight_[evt]; }
+  const std::vector<double>& weights() const { return weight_; }
+
+  bool hasUnc() const { return uncLabels_.size() > 0; }
+  unsigned int nUnc() const { return uncLabels_.size(); }
+  const std::vector<TString>& uncLabels() const { return uncLabels_; }
+  double relTotalUncDn(unsigned int evt) const { return relTotalUncDn_[evt]; }
+  double relTotalUncUp(unsigned int evt) const { return relTotalUncUp_[evt]; }
+  double relUncDn(unsigned int unc, unsigned int evt) const { return relUncDn_[unc][evt]; }
+  double relUncUp(unsigned int unc, unsigned int evt) const { return relUncUp_[unc][evt]; }
+  const std::vector<double>& relTotalUncDnColumn() const { return relTotalUncDn_; }
+  const std::vector<double>& relTotalUncUpColumn() const { return relTotalUncUp_; }
+  const std::vector<double>& relUncDnColumn(unsigned int unc) const { return relUncDn_.at(unc); }
+  const std::vector<double>& relUncUpColumn(unsigned int unc) const { return relUncUp_.at(unc); }
+  int uncIdx(const TString &label) const;
+
+
+private:
+  std::vector< std::vector<double> > vars_; // Needs double precision for correct display of runnumber!!!
+  std::vector<double> weight_;
+  std::vector<TString> uncLabels_;
+  std::vector<double> relTotalUncDn_;
+  std::vector<double> relTotalUncUp_;
+  std::vector< std::vector<double> > relUncDn_;
+  std::vector< std::vector<double> > relUncUp_;
+
+  void addRelUnc(unsigned int unc, double dn, double up);
+};
+
+
+// Bit mask over the events of an EventStore with one bit per
+// event, e.g. whether the event passes a selection
+class EventMask {
+public:
+  EventMask() : size_(0), count_(0) {};
+  EventMask(unsigned int size) : words_((size+31)/32,0), size_(size), count_(0) {};
+
+  unsigned int size() const { return size_; }
+  unsigned int count() const { return count_; }
+  bool test(unsigned int evt) const { return words_[evt/32] & (1u << (evt%32)); }
+  void set(unsigned int evt) {
+    if( !test(evt) ) {
+      words_[evt/32] |= (1u << (evt%32));
+      ++count_;
+    }
+  }
+  unsigned int next(unsigned int evt) const;	// First set bit >= evt or size()
+
+
 private:
-  static std::map<TString,unsigned int> varIdx_;
+  std::vector<unsigned int> words_;
+  unsigned int size_;
+  unsigned int count_;
+};
 
-  const double weight_;
 
-  std::vector<double> vars_; // Needs double precision for correct display of runnumber!!!
-  double relTotalUncDn_;
-  double relTotalUncUp_;
-  std::map<TString,double> relUncDn_;
-  std::map<TString,double> relUncUp_;
+// Iterates over the events of an EventStore, either over all
+// of them or over the events set in a mask
+class EventIt {
+public:
+  EventIt() : store_(0), pos_(0), mask_(0) {};
+  EventIt(const EventStore* store, unsigned int pos, const EventMask* mask = 0)
+    : evt_(store,0), store_(store), pos_(mask ? mask->next(pos) : pos), mask_(mask) {};
+
+  const Event& operator*() const { evt_ = Event(store_,pos_); return evt_; }
+  const Event* operator->() const { return &(operator*()); }
+  EventIt& operator++() { pos_ = mask_ ? mask_->next(pos_+1) : pos_+1; return *this; }
+  bool operator==(const EventIt &it) const { return pos_ == it.pos_ && store_ == it.store_; }
+  bool operator!=(const EventIt &it) const { return !(*this == it); }
 
-  Event();
-  Event(double weight);
-  void init();
-  void set(const TString &var, double val);
-  void addRelUnc(double dn, double up, const TString &label = "label");
+private:
+  mutable Event evt_;
+  const EventStore* store_;
+  unsigned int pos_;
+  const EventMask* mask_;
 };
 
-typedef std::vector<Event*> Events;
-typedef std::vector<Event*>::const_iterator EventIt;
+
+// Access by resolved variable index, see Variable::index()
+inline double Event::get(unsigned int var) const { return store_->get(var,idx_); }
 #endif
@@ -1,38 +1,149 @@
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <sys/stat.h>
 #include <vector>
 
+#include "RVersion.h"
+#include "TBranch.h"
 #include "TChain.h"
 #include "TFile.h"
+#include "TMutex.h"
+#include "TROOT.h"
+#include "TThread.h"
+#include "TTree.h"
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,18,0)
+#include "Bytes.h"
+#include "TBufferFile.h"
+#include "TLeaf.h"
+#include "TMath.h"
+#endif
 
 #include "EventBuilder.h"
+#include "Profiler.h"
 #include "Variable.h"
 
 
-Events EventBuilder::operator()(const TString &fileName, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, double scale) const {
+// Reads one branch of type T into a column of a store. The type
+// is resolved once per file, hence there is no per-entry dispatch
+// on the type name. If the tree has no such branch, i.e. 'branch'
+// is empty, the value is 0.
+class EventBuilder::Reader {
+public:
+  static Reader* create(const TString &type, const TString &branch, std::vector<double> &column);
+
+  Reader(const TString &type, const TString &branch, std::vector<double> &column)
+    : type_(type), branch_(branch), column_(column) {};
+  virtual ~Reader() {};
+
+  virtual void setAddress(TChain* chain) = 0;
+  // Appends the value of the current entry to the column
+  virtual void read() = 0;
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,18,0)
+  // Flat branch of this type whose baskets can be decoded directly
+  bool supportsBulkRead(TTree* tree) const;
+  // Appends the values of the entries [first,last), basket by basket
+  virtual void readBulk(TTree* tree, Long64_t first, Long64_t last) = 0;
+#endif
+
+
+protected:
+  const TString type_;
+  const TString branch_;
+  std::vector<double> &column_;
+};
+
+
+template<class T>
+class EventBuilder::ReaderT : public EventBuilder::Reader {
+public:
+  ReaderT(const TString &type, const TString &branch, std::vector<double> &column)
+    : Reader(type,branch,column), value_(0) {};
+
+  void setAddress(TChain* chain) { if( branch_ != "" ) chain->SetBranchAddress(branch_,&value_); }
+  void read() { column_.push_back(value_); }
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,18,0)
+  void readBulk(TTree* tree, Long64_t first, Long64_t last);
+#endif
+
+
+private:
+  T value_;
+};
+
+
+EventBuilder::Reader* EventBuilder::Reader::create(const TString &type, const TString &branch, std::vector<double> &column) {
+  if( type == "Double_t" ) return new ReaderT<Double_t>(type,branch,column);
+  if( type == "Float_t" ) return new ReaderT<Float_t>(type,branch,column);
+  if( type == "Int_t" ) return new ReaderT<Int_t>(type,branch,column);
+  if( type == "UInt_t" ) return new ReaderT<UInt_t>(type,branch,column);
+  if( type == "UShort_t" ) return new ReaderT<UShort_t>(type,branch,column);
+  if( type == "UChar_t" ) return new ReaderT<UChar_t>(type,branch,column);
+
+  std::cerr << "\n\nERROR in EventBuilder: no reader for type '" << type << "'" << std::endl;
+  exit(-1);
+
+  return 0;
+}
+
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,18,0)
+bool EventBuilder::Reader::supportsBulkRead(TTree* tree) const {
+  if( branch_ == "" ) return true;
+  TBranch* branch = tree->GetBranch(branch_);
+  if( branch == 0 || branch->GetNleaves() != 1 ) return false;
+  const TLeaf* leaf = static_cast<TLeaf*>(branch->GetListOfLeaves()->At(0));
+  if( leaf->GetLen() != 1 || leaf->GetLeafCount() != 0 || type_ != leaf->GetTypeName() ) return false;
+
+  return branch->GetBulkRead().SupportsBulkRead();
+}
+
+
+template<class T>
+void EventBuilder::ReaderT<T>::readBulk(TTree* tree, Long64_t first, Long64_t last) {
+  if( branch_ == "" ) {
+    column_.insert(column_.end(),last-first,0.);
+    return;
+  }
+
+  TBranch* branch = tree->GetBranch(branch_);
+  TBufferFile buffer(TBuffer::kWrite,32*1024);
+  Long64_t entry = first;
+  while( entry < last ) {
+    // Baskets are decoded as a whole, starting at their first entry
+    const Int_t basket = TMath::BinarySearch(branch->GetWriteBasket()+1,branch->GetBasketEntry(),entry);
+    const Long64_t basketFirst = branch->GetBasketEntry()[basket];
+    const Int_t count = branch->GetBulkRead().GetEntriesSerialized(basketFirst,buffer);
+    if( count <= 0 ) {
+      std::cerr << "\n\nERROR in EventBuilder: cannot read entry " << entry << " of branch '" << branch_ << "'" << std::endl;
+      exit(-1);
+    }
+    // The values are serialized in big-endian order
+    char* data = buffer.GetCurrent();
+    for(Long64_t i = basketFirst; i < basketFirst+count && i < last; ++i) {
+      frombuf(data,&value_);
+      if( i >= entry ) column_.push_back(value_);
+    }
+    entry = basketFirst+count;
+  }
+}
+#endif
+
+
+unsigned int EventBuilder::operator()(const TString &fileName, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, double scale, EventStore &store, unsigned int first, unsigned int n) const {
   assert( uncDn.size() == uncUp.size() );
   assert( uncDn.size() == uncLabel.size() );
+  assert( uncLabel.size() == store.nUnc() );
+  Profiler::Timer timer("EventBuilder::read "+fileName);
 
   // Get tree from file
   TChain* chain = new TChain(treeName,treeName);
   chain->Add(fileName);
 
-  // Setup vector with variables to be read from chain
-  std::vector<Double_t> varsDouble_t(Variable::nVars(),0.);
-  std::vector<Float_t> varsFloat_t(Variable::nVars(),0.);
-  std::vector<Int_t> varsInt_t(Variable::nVars(),0);
-  std::vector<UInt_t> varsUInt_t(Variable::nVars(),0);
-  std::vector<UShort_t> varsUShort_t(Variable::nVars(),0);
-  std::vector<UChar_t> varsUChar_t(Variable::nVars(),0);
-  unsigned int idxDouble_t = 0;
-  unsigned int idxFloat_t = 0;
-  unsigned int idxInt_t = 0;
-  unsigned int idxUInt_t = 0;
-  unsigned int idxUShort_t = 0;
-  unsigned int idxUChar_t = 0;
-
   // Parse weight variable
   Float_t varWeight = 1.;
   if( weight.IsFloat() ) varWeight = weight.Atof();
@@ -59,84 +170,104 @@ Events EventBuilder::operator()(const TString &fileName, const TString &treeName
     }
   }
 
-  // Setup branches
-  for(std::vector<TString>::const_iterator it = Variable::begin(); it != Variable::end(); ++it) {
-    bool treeHasVar = true;
-    if( chain->GetListOfBranches()->FindObject(*it) == 0 ) {
+  // Setup branches. Only the branches of the used variables
+  // (see Variable::use()) and of the weight and uncertainty
+  // variables are read; all other branches are disabled.
+  // The branch of each used variable is read by a Reader of its
+  // type into the variable's column.
+  chain->SetBranchStatus("*",0);
+  std::vector<Reader*> readers;
+  std::vector<TString> weightBranches(1+2*uncDn.size()); // Weight, uncertainties dn, up
+  std::vector<TString> readBranches;
+  unsigned int var = 0;
+  for(std::vector<TString>::const_iterator it = Variable::begin(); it != Variable::end(); ++it, ++var) {
+    const bool isRead = EventBuilder::isRead(*it,weight,uncDn,uncUp);
+    bool treeHasVar = isRead;
+    if( isRead && chain->GetListOfBranches()->FindObject(*it) == 0 ) {
       treeHasVar = false;
+    }
+    if( isRead && !treeHasVar && first == 0 ) {
       std::cerr << "\nWARNING in EventBuilder" << std::endl;
       std::cerr << "  - TTree '" << treeName << "' in file '" << chain->GetFile()->GetName() << "' has no variable named '" << *it << "'" << std::endl;
       std::cerr << "  - Using default value 0 instead" << std::endl;
     }
-    if( Variable::type(*it) == "Float_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsFloat_t.at(idxFloat_t));
-      ++idxFloat_t;
-      if( *it == weight && treeHasVar ) {
+    if( treeHasVar ) {
+      chain->SetBranchStatus(*it,1);
+      readBranches.push_back(*it);
+    }
+    // The branches of Float_t weight and uncertainty variables are
+    // read into the weight and uncertainties only; the columns of
+    // these variables are 0.
+    bool isWeight = false;
+    if( treeHasVar && Variable::type(*it) == "Float_t" ) {
+      if( *it == weight ) {
 	chain->SetBranchAddress(*it,&varWeight);
+	weightBranches.at(0) = *it;
+	isWeight = true;
       }
       for(unsigned int i = 0; i < uncDn.size(); ++i) {
-	if( *it == uncDn.at(i) && treeHasVar ) {
+	if( *it == uncDn.at(i) ) {
 	  chain->SetBranchAddress(*it,&varsUncDn.at(i));
+	  weightBranches.at(1+i) = *it;
+	  isWeight = true;
 	}
-	if( *it == uncUp.at(i) && treeHasVar && !symUnc.at(i) ) {
+	if( *it == uncUp.at(i) && !symUnc.at(i) ) {
 	  chain->SetBranchAddress(*it,&varsUncUp.at(i));
+	  weightBranches.at(1+uncDn.size()+i) = *it;
+	  isWeight = true;
 	}
       }
-    } else if( Variable::type(*it) == "Double_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsDouble_t.at(idxDouble_t));
-      ++idxDouble_t;
-    } else if( Variable::type(*it) == "Int_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsInt_t.at(idxInt_t));
-      ++idxInt_t;
-    } else if( Variable::type(*it) == "UInt_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsUInt_t.at(idxUInt_t));
-      ++idxUInt_t;
-    } else if( Variable::type(*it) == "UShort_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsUShort_t.at(idxUShort_t));
-      ++idxUShort_t;
-    } else if( Variable::type(*it) == "UChar_t" ) {
-      if( treeHasVar ) chain->SetBranchAddress(*it,&varsUChar_t.at(idxUChar_t));
-      ++idxUChar_t;
+    }
+    // Unused variables are not read, their columns stay empty
+    if( Variable::isUsed(var) ) {
+      Reader* reader = Reader::create(Variable::type(*it),treeHasVar && !isWeight ? *it : "",store.vars_[var]);
+      reader->setAddress(chain);
+      readers.push_back(reader);
     }
   }  
 
-  // Loop over tree and build events
-  Events evts;
-  for(int i = 0; i < chain->GetEntries(); ++i) {
+  // Optionally, the baskets of the read branches are fetched in
+  // large blocks via the TTreeCache, which is trained on these
+  // branches right away
+  if( treeCacheSize_ > 0 ) {
+    chain->SetCacheSize(1024*1024*static_cast<Long64_t>(treeCacheSize_));
+    for(std::vector<TString>::const_iterator it = readBranches.begin(); it != readBranches.end(); ++it) {
+      chain->AddBranchToCache(*it,kTRUE);
+    }
+    chain->StopCacheLearningPhase();
+  }
+
+  // Loop over the requested entries and append the events
+  // to the columns of the store
+  const unsigned int nEntries = chain->GetEntries();
+  unsigned int last = nEntries;
+  if( n > 0 && first < nEntries && n < nEntries-first ) last = first+n;
+  if( first < last ) store.reserve(store.size()+last-first);
+
+  // Optionally, all branches are read at once basket by basket, and
+  // the weights and uncertainties are taken from 'weightColumns'
+  std::vector< std::vector<double> > weightColumns(weightBranches.size());
+  const bool isBulkRead = bulkRead_ && first < last && readBulk(chain,first,last,readers,weightBranches,weightColumns);
+
+  for(unsigned int i = first; i < last; ++i) {
 
     // Read variables of this entry
-    chain->GetEntry(i);
-
-    // Create new event and fill variables
-    Event* evt = new Event(varWeight*scale);
-    idxDouble_t = 0;
-    idxFloat_t = 0;
-    idxInt_t = 0;
-    idxUInt_t = 0;
-    idxUShort_t = 0;
-    idxUChar_t = 0;
-    for(std::vector<TString>::const_iterator it = Variable::begin(); it != Variable::end(); ++it) {
-      if( Variable::type(*it) == "Double_t" ) {
-	evt->set(*it,varsDouble_t.at(idxDouble_t));
-	++idxDouble_t;
-      } else if( Variable::type(*it) == "Float_t" ) {
-	evt->set(*it,varsFloat_t.at(idxFloat_t));
-	++idxFloat_t;
-      } else if( Variable::type(*it) == "Int_t" ) {
-	evt->set(*it,varsInt_t.at(idxInt_t));
-	++idxInt_t;
-      } else if( Variable::type(*it) == "UInt_t" ) {
-	evt->set(*it,varsUInt_t.at(idxUInt_t));
-	++idxUInt_t;
-      } else if( Variable::type(*it) == "UShort_t" ) {
-	evt->set(*it,varsUShort_t.at(idxUShort_t));
-	++idxUShort_t;
-      } else if( Variable::type(*it) == "UChar_t" ) {
-	evt->set(*it,varsUChar_t.at(idxUChar_t));
-	++idxUChar_t;
+    if( isBulkRead ) {
+      if( weightBranches.at(0) != "" ) varWeight = weightColumns.at(0).at(i-first);
+      for(unsigned int u = 0; u < uncDn.size(); ++u) {
+	if( weightBranches.at(1+u) != "" ) varsUncDn.at(u) = weightColumns.at(1+u).at(i-first);
+	if( weightBranches.at(1+uncDn.size()+u) != "" ) varsUncUp.at(u) = weightColumns.at(1+uncDn.size()+u).at(i-first);
+      }
+    } else {
+      chain->GetEntry(i);
+      for(std::vector<Reader*>::const_iterator it = readers.begin(); it != readers.end(); ++it) {
+	(*it)->read();
       }
     }
 
+    // Add new event
+    store.weight_.push_back(varWeight*scale);
+
     for(unsigned int i = 0; i < uncDn.size(); ++i) {
       double udn = varsUncDn.at(i);
       double uup = varsUncUp.at(i);
@@ -155,13 +286,267 @@ Events EventBuilder::operator()(const TString &fileName, const TString &treeName
 	  uup = 0.;
 	}
       }
-      evt->addRelUnc(udn,uup,uncLabel.at(i));
+      store.addRelUnc(i,udn,uup);
     }
-
-    evts.push_back(evt);
   }
 
+  Profiler::count("EventBuilder::read "+fileName,"entries",last > first ? last-first : 0);
+  if( isBulkRead ) Profiler::count("EventBuilder::read "+fileName,"bulk entries",last-first);
+  if( chain->GetFile() ) {
+    Profiler::count("EventBuilder::read "+fileName,"bytes",chain->GetFile()->GetBytesRead());
+    Profiler::count("EventBuilder::read "+fileName,"read calls",chain->GetFile()->GetReadCalls());
+  }
+  for(std::vector<Reader*>::iterator it = readers.begin(); it != readers.end(); ++it) {
+    delete *it;
+  }
   delete chain;
 
-  return evts;
+  return nEntries;
+}
+
+
+
+// Reads the entries [first,last) of the variable branches into the
+// columns of the readers and of the Float_t 'weightBranches' into
+// 'weightColumns', decoding whole baskets at once (bulk I/O). This
+// requires ROOT 6.18 or later, a single tree, and flat branches of
+// the declared types. Returns false, without reading anything, if
+// this is not the case.
+bool EventBuilder::readBulk(TChain* chain, unsigned int first, unsigned int last, const std::vector<Reader*> &readers, const std::vector<TString> &weightBranches, std::vector< std::vector<double> > &weightColumns) const {
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,18,0)
+  if( chain->GetNtrees() != 1 || chain->LoadTree(first) < 0 ) return false;
+  TTree* tree = chain->GetTree();
+
+  std::vector<Reader*> weightReaders;
+  for(unsigned int i = 0; i < weightBranches.size(); ++i) {
+    weightReaders.push_back(Reader::create("Float_t",weightBranches.at(i),weightColumns.at(i)));
+  }
+  bool isSupported = true;
+  for(std::vector<Reader*>::const_iterator it = readers.begin(); it != readers.end(); ++it) {
+    if( !(*it)->supportsBulkRead(tree) ) isSupported = false;
+  }
+  for(std::vector<Reader*>::const_iterator it = weightReaders.begin(); it != weightReaders.end(); ++it) {
+    if( !(*it)->supportsBulkRead(tree) ) isSupported = false;
+  }
+  if( isSupported ) {
+    for(std::vector<Reader*>::const_iterator it = readers.begin(); it != readers.end(); ++it) {
+      (*it)->readBulk(tree,first,last);
+    }
+    for(std::vector<Reader*>::const_iterator it = weightReaders.begin(); it != weightReaders.end(); ++it) {
+      (*it)->readBulk(tree,first,last);
+    }
+  }
+  for(std::vector<Reader*>::iterator it = weightReaders.begin(); it != weightReaders.end(); ++it) {
+    delete *it;
+  }
+
+  return isSupported;
+#else
+  return false;
+#endif
+}
+
+
+
+bool EventBuilder::isRead(const TString &var, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp) {
+  if( Variable::isUsed(var) || var == weight ) return true;
+  for(unsigned int i = 0; i < uncDn.size(); ++i) {
+    if( var == uncDn.at(i) || var == uncUp.at(i) ) return true;
+  }
+
+  return false;
+}
+
+
+
+EventBuilder::Prefetcher::Prefetcher(const Job* job)
+  : thread_(0) {
+  if( job != 0 ) {
+    fileName_ = job->fileName_;
+    treeName_ = job->treeName_;
+    for(std::vector<TString>::const_iterator it = Variable::begin(); it != Variable::end(); ++it) {
+      if( isRead(*it,job->weight_,job->uncDn_,job->uncUp_) ) branches_.push_back(*it);
+    }
+    initThreads();
+    thread_ = new TThread(Prefetcher::read,this);
+    thread_->Run();
+  }
+}
+
+
+EventBuilder::Prefetcher::~Prefetcher() {
+  if( thread_ ) {
+    thread_->Join();
+    delete thread_;
+  }
+}
+
+
+// Reads the baskets of the branches in file order, in vectored
+// reads of up to 4 MB, and discards the data. Files that cannot be
+// opened, e.g. names with wildcards, are skipped.
+void* EventBuilder::Prefetcher::read(void* prefetcher) {
+  const Prefetcher* p = static_cast<Prefetcher*>(prefetcher);
+  Profiler::Timer timer("EventBuilder::prefetch "+p->fileName_);
+  TFile* file = TFile::Open(p->fileName_);
+  if( file == 0 ) return 0;
+  TTree* tree = file->IsZombie() ? 0 : dynamic_cast<TTree*>(file->Get(p->treeName_));
+  if( tree != 0 ) {
+    std::vector< std::pair<Long64_t,Int_t> > baskets; // Position, length
+    for(std::vector<TString>::const_iterator it = p->branches_.begin(); it != p->branches_.end(); ++it) {
+      TBranch* branch = tree->GetBranch(*it);
+      if( branch == 0 ) continue;
+      for(Int_t i = 0; i < branch->GetWriteBasket(); ++i) {
+	if( branch->GetBasketBytes()[i] > 0 ) baskets.push_back(std::make_pair(branch->GetBasketSeek(i),branch->GetBasketBytes()[i]));
+      }
+    }
+    std::sort(baskets.begin(),baskets.end());
+
+    const Long64_t blockSize = 4*1024*1024;
+    std::vector<char> buffer;
+    Long64_t nBytes = 0;
+    unsigned int begin = 0;
+    while( begin < baskets.size() ) {
+      std::vector<Long64_t> pos;
+      std::vector<Int_t> len;
+      Long64_t size = 0;
+      for(unsigned int i = begin; i < baskets.size() && ( i == begin || size+baskets[i].second <= blockSize ); ++i) {
+	pos.push_back(baskets[i].first);
+	len.push_back(baskets[i].second);
+	size += baskets[i].second;
+      }
+      buffer.resize(size);
+      if( file->ReadBuffers(&(buffer[0]),&(pos[0]),&(len[0]),pos.size()) ) break; // Returns true in case of errors
+      nBytes += size;
+      begin += pos.size();
+    }
+    Profiler::count("EventBuilder::prefetch "+p->fileName_,"bytes",nBytes);
+  }
+  delete file;
+
+  return 0;
+}
+
+
+
+// Jobs shared by the worker threads. Each thread takes the next
+// unprocessed job until all jobs are done.
+class EventBuilder::Queue {
+public:
+  Queue(const EventBuilder* builder, std::vector<Job> &jobs)
+    : builder_(builder), jobs_(jobs), next_(0), nextPrefetch_(0) {};
+
+  // The job returned by the next call of next(), or 0 if it has
+  // been returned by this method before
+  const Job* nextPrefetch() {
+    const Job* job = 0;
+    mutex_.Lock();
+    if( next_ < jobs_.size() && next_ >= nextPrefetch_ ) {
+      job = &(jobs_.at(next_));
+      nextPrefetch_ = next_+1;
+    }
+    mutex_.UnLock();
+
+    return job;
+  }
+
+  Job* next() {
+    Job* job = 0;
+    mutex_.Lock();
+    if( next_ < jobs_.size() ) {
+      job = &(jobs_.at(next_));
+      ++next_;
+    }
+    mutex_.UnLock();
+
+    return job;
+  }
+
+  const EventBuilder* builder_;
+
+
+private:
+  std::vector<Job> &jobs_;
+  unsigned int next_;
+  unsigned int nextPrefetch_;	// Index after the last job returned by nextPrefetch()
+  TMutex mutex_;
+};
+
+
+void* EventBuilder::work(void* queue) {
+  Queue* q = static_cast<Queue*>(queue);
+  const EventBuilder* builder = q->builder_;
+  for(Job* job = q->next(); job != 0; job = q->next()) {
+    // Read ahead the input file of the next job meanwhile
+    const Prefetcher prefetcher(builder->prefetch_ ? q->nextPrefetch() : 0);
+    const TString key = builder->cacheKey(*job);
+    bool isCached = false;
+    if( builder->cache_.isEnabled() ) {
+      Profiler::Timer timer("EventCache::read "+job->fileName_);
+      isCached = builder->cache_.read(key,*(job->store_));
+      if( isCached ) Profiler::count("EventCache::read "+job->fileName_,"entries",job->store_->size());
+    }
+    if( !isCached ) {
+      (*builder)(job->fileName_,job->treeName_,job->weight_,job->uncDn_,job->uncUp_,job->uncLabel_,job->scale_,*(job->store_));
+      builder->cache_.write(key,*(job->store_));
+    }
+  }
+
+  return 0;
+}
+
+
+// On ROOT 6, the global lists of files and classes are protected
+// only if thread safety is enabled explicitly
+void EventBuilder::initThreads() {
+  TThread::Initialize();
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,6,0)
+  ROOT::EnableThreadSafety();
+#endif
+}
+
+
+void EventBuilder::operator()(std::vector<Job> &jobs, unsigned int nThreads) const {
+  Queue queue(this,jobs);
+  if( nThreads < 2 || jobs.size() < 2 ) {
+    work(&queue);
+  } else {
+    if( nThreads > jobs.size() ) nThreads = jobs.size();
+    initThreads();
+    std::vector<TThread*> threads(nThreads,0);
+    for(unsigned int i = 0; i < nThreads; ++i) {
+      threads.at(i) = new TThread(EventBuilder::work,&queue);
+      threads.at(i)->Run();
+    }
+    for(unsigned int i = 0; i < nThreads; ++i) {
+      threads.at(i)->Join();
+      delete threads.at(i);
+    }
+  }
+}
+
+
+// Everything the store of a job depends on: the input file and its
+// modification time and size, the tree, the weight and uncertainty
+// definitions, and the used variables. Returns an empty key, i.e.
+// no caching, if the cache is disabled or the input file cannot be
+// found (e.g. if the file name contains wildcards).
+TString EventBuilder::cacheKey(const Job &job) const {
+  struct stat st;
+  if( !cache_.isEnabled() || stat(job.fileName_.Data(),&st) != 0 ) return "";
+
+  TString key = "file: "+job.fileName_;
+  key += TString::Format("; mtime: %ld; size: %ld",static_cast<long>(st.st_mtime),static_cast<long>(st.st_size));
+  key += "; tree: "+job.treeName_;
+  key += "; weight: "+job.weight_;
+  key += TString::Format("; scale: %.17g",job.scale_);
+  for(unsigned int i = 0; i < job.uncLabel_.size(); ++i) {
+    key += "; uncertainty "+job.uncLabel_.at(i)+": "+job.uncDn_.at(i)+", "+job.uncUp_.at(i);
+  }
+  key += "; variables:";
+  for(std::vector<TString>::const_iterator it = Variable::begin(); it != Variable::end(); ++it) {
+    if( Variable::isUsed(*it) ) key += " "+(*it)+" ("+Variable::type(*it)+")";
+  }
+
+  return key;
 }
@@ -1,12 +1,94 @@
 #ifndef EVENT_BUILDER_H
 #define EVENT_BUILDER_H
 
+#include <vector>
+
 #include "TString.h"
 
 #include "Event.h"
+#include "EventCache.h"
+
+class TChain;
+class TThread;
 
 class EventBuilder {
 public:
-  Events operator()(const TString &fileName, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, double scale) const;
+  // One input file to be read into its own store
+  class Job {
+  public:
+    Job(const TString &fileName, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, double scale)
+      : fileName_(fileName), treeName_(treeName), weight_(weight), uncDn_(uncDn), uncUp_(uncUp), uncLabel_(uncLabel), scale_(scale), store_(new EventStore(uncLabel)) {};
+
+    TString fileName_;
+    TString treeName_;
+    TString weight_;
+    std::vector<TString> uncDn_;
+    std::vector<TString> uncUp_;
+    std::vector<TString> uncLabel_;
+    double scale_;
+    EventStore* store_;		// Filled by EventBuilder; ownership is with the caller
+  };
+
+  // Reads the baskets of the branches that the job will read in a
+  // background thread while it exists, such that they are in the page
+  // cache of the operating system when they are needed, e.g. for the
+  // next input file while the current one is processed. This helps
+  // for local and network-mounted files only: remote protocols such
+  // as xrootd cache the data per opened file. Nothing is done if
+  // 'job' is 0.
+  class Prefetcher {
+  public:
+    Prefetcher(const Job* job);
+    ~Prefetcher();
+
+  private:
+    TString fileName_;
+    TString treeName_;
+    std::vector<TString> branches_;
+    TThread* thread_;
+
+    static void* read(void* prefetcher);
+  };
+
+  // If 'cacheDir' is not empty, the stores of the jobs are
+  // cached there and read back in later runs, see EventCache.
+  // If 'bulkRead' is true, flat trees are read basket by basket
+  // where supported, see readBulk(). If 'treeCacheSize' (in MB) is
+  // larger than 0, a TTreeCache of this size is used. If 'prefetch'
+  // is true, the input file of the next job is read ahead, see
+  // Prefetcher.
+  EventBuilder(const TString &cacheDir = "", bool bulkRead = false, unsigned int treeCacheSize = 0, bool prefetch = false)
+    : cache_(cacheDir), bulkRead_(bulkRead), treeCacheSize_(treeCacheSize), prefetch_(prefetch) {};
+
+  // Reads the events from the tree and appends them to 'store'.
+  // Only the 'n' entries starting at 'first' are read, all if 'n'
+  // is 0. Returns the total number of entries in the tree.
+  unsigned int operator()(const TString &fileName, const TString &treeName, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp, const std::vector<TString> &uncLabel, double scale, EventStore &store, unsigned int first = 0, unsigned int n = 0) const;
+
+  // Processes all jobs using up to 'nThreads' threads. Each job
+  // fills its own store, hence the result does not depend on the
+  // order in which the jobs are processed.
+  void operator()(std::vector<Job> &jobs, unsigned int nThreads) const;
+
+  // Has to be called before threads that read files are started
+  static void initThreads();
+
+
+private:
+  class Queue;
+  class Reader;
+  template<class T> class ReaderT;
+  static void* work(void* queue);
+  // Whether the branch of variable 'var' is read for a tree with
+  // these weight and uncertainty variables
+  static bool isRead(const TString &var, const TString &weight, const std::vector<TString> &uncDn, const std::vector<TString> &uncUp);
+
+  const EventCache cache_;
+  const bool bulkRead_;
+  const unsigned int treeCacheSize_;
+  const bool prefetch_;
+
+  bool readBulk(TChain* chain, unsigned int first, unsigned int last, const std::vector<Reader*> &readers, const std::vector<TString> &weightBranches, std::vector< std::vector<double> > &weightColumns) const;
+  TString cacheKey(const Job &job) const;
 };
 #endif
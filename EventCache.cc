@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Config.h"
+#include "EventCache.h"
+#include "GlobalParameters.h"
+#include "Variable.h"
+
+
+// Layout of a cache file (native byte order):
+//   8 bytes magic
+//   UInt_t  length of the key, followed by the key, padded to 8 bytes
+//   UInt_t  number of events
+//   UInt_t  number of variable columns (the used variables)
+//   Double_t columns: variables in order of their index, weights, and
+//            if there are uncertainties, total dn and up uncertainties
+//            and dn and up uncertainties per label
+const char* EventCache::magic_ = "MrRA2EC1";
+
+
+// The file name is a hash of the key; the key itself is stored
+// in the file to detect collisions
+// ---------------------------------------------------------------
+TString EventCache::fileName(const TString &key) const {
+  return dir_+"/"+Config::hash(key)+".evts";
+}
+
+
+// ---------------------------------------------------------------
+bool EventCache::read(const TString &key, EventStore &store) const {
+  if( !isEnabled() || key == "" || store.size() > 0 ) return false;
+
+  const TString name = fileName(key);
+  int fd = open(name.Data(),O_RDONLY);
+  if( fd < 0 ) return false;
+  struct stat st;
+  if( fstat(fd,&st) != 0 || st.st_size == 0 ) {
+    close(fd);
+    return false;
+  }
+  const size_t size = st.st_size;
+  void* addr = mmap(0,size,PROT_READ,MAP_PRIVATE,fd,0);
+  close(fd);
+  if( addr == MAP_FAILED ) return false;
+
+  // Check the header
+  const char* data = static_cast<const char*>(addr);
+  bool isValid = false;
+  size_t pos = 8+sizeof(UInt_t);
+  UInt_t nEvts = 0;
+  unsigned int nCols = 0;
+  if( size >= pos && std::memcmp(data,magic_,8) == 0 ) {
+    UInt_t keyLength = 0;
+    std::memcpy(&keyLength,data+8,sizeof(UInt_t));
+    if( size >= pos+keyLength && key == TString(data+pos,keyLength) ) {
+      pos += keyLength;
+      pos += (8 - pos%8) % 8;
+      UInt_t nFileCols = 0;
+      if( size >= pos+2*sizeof(UInt_t) ) {
+	std::memcpy(&nEvts,data+pos,sizeof(UInt_t));
+	std::memcpy(&nFileCols,data+pos+sizeof(UInt_t),sizeof(UInt_t));
+	pos += 2*sizeof(UInt_t);
+	for(unsigned int var = 0; var < store.nVars(); ++var) {
+	  if( Variable::isUsed(var) ) ++nCols;
+	}
+	unsigned int nAllCols = nCols + 1 + (store.hasUnc() ? 2+2*store.nUnc() : 0);
+	isValid = nFileCols == nCols && size == pos + sizeof(Double_t)*nAllCols*nEvts;
+      }
+    }
+  }
+
+  // Copy the columns
+  if( isValid ) {
+    const Double_t* col = reinterpret_cast<const Double_t*>(data+pos);
+    for(unsigned int var = 0; var < store.nVars(); ++var) {
+      if( Variable::isUsed(var) ) {
+	store.vars_.at(var).assign(col,col+nEvts);
+	col += nEvts;
+      }
+    }
+    store.weight_.assign(col,col+nEvts);
+    col += nEvts;
+    if( store.hasUnc() ) {
+      store.relTotalUncDn_.assign(col,col+nEvts);
+      col += nEvts;
+      store.relTotalUncUp_.assign(col,col+nEvts);
+      col += nEvts;
+      for(unsigned int i = 0; i < store.nUnc(); ++i) {
+	store.relUncDn_.at(i).assign(col,col+nEvts);
+	col += nEvts;
+	store.relUncUp_.at(i).assign(col,col+nEvts);
+	col += nEvts;
+      }
+    }
+  } else {
+    std::cerr << "\nWARNING in EventCache: ignoring invalid cache file '" << name << "'" << std::endl;
+  }
+  munmap(addr,size);
+
+  if( isValid && GlobalParameters::debug() ) {
+    std::cout << "DEBUG: Read " << nEvts << " events from cache file '" << name << "'" << std::endl;
+  }
+
+  return isValid;
+}
+
+
+// The file is written under a temporary name and then renamed,
+// such that concurrent runs never see incomplete files
+// ---------------------------------------------------------------
+void EventCache::write(const TString &key, const EventStore &store) const {
+  if( !isEnabled() || key == "" ) return;
+
+  const TString name = fileName(key);
+  const TString tmpName = TString::Format("%s.%d.%p",name.Data(),getpid(),static_cast<const void*>(&store));
+  std::ofstream file(tmpName.Data(),std::ios::binary);
+  if( !file.is_open() ) {
+    std::cerr << "\nWARNING in EventCache: cannot write cache file '" << tmpName << "'" << std::endl;
+    return;
+  }
+
+  // Header
+  const char pad[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+  const UInt_t keyLength = key.Length();
+  file.write(magic_,8);
+  file.write(reinterpret_cast<const char*>(&keyLength),sizeof(UInt_t));
+  file.write(key.Data(),keyLength);
+  file.write(pad,(8 - (8+sizeof(UInt_t)+keyLength)%8) % 8);
+  const UInt_t nEvts = store.size();
+  UInt_t nCols = 0;
+  for(unsigned int var = 0; var < store.nVars(); ++var) {
+    if( Variable::isUsed(var) ) ++nCols;
+  }
+  file.write(reinterpret_cast<const char*>(&nEvts),sizeof(UInt_t));
+  file.write(reinterpret_cast<const char*>(&nCols),sizeof(UInt_t));
+
+  // Columns
+  std::vector<const std::vector<double>*> cols;
+  for(unsigned int var = 0; var < store.nVars(); ++var) {
+    if( Variable::isUsed(var) ) cols.push_back(&(store.vars_.at(var)));
+  }
+  cols.push_back(&(store.weight_));
+  if( store.hasUnc() ) {
+    cols.push_back(&(store.relTotalUncDn_));
+    cols.push_back(&(store.relTotalUncUp_));
+    for(unsigned int i = 0; i < store.nUnc(); ++i) {
+      cols.push_back(&(store.relUncDn_.at(i)));
+      cols.push_back(&(store.relUncUp_.at(i)));
+    }
+  }
+  for(std::vector<const std::vector<double>*>::const_iterator it = cols.begin();
+      it != cols.end(); ++it) {
+    if( nEvts > 0 ) file.write(reinterpret_cast<const char*>(&((**it)[0])),sizeof(Double_t)*nEvts);
+  }
+  file.close();
+
+  if( file.fail() || std::rename(tmpName.Data(),name.Data()) != 0 ) {
+    std::cerr << "\nWARNING in EventCache: cannot write cache file '" << name << "'" << std::endl;
+    std::remove(tmpName.Data());
+  } else if( GlobalParameters::debug() ) {
+    std::cout << "DEBUG: Wrote " << nEvts << " events to cache file '" << name << "'" << std::endl;
+  }
+}
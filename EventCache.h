@@ -0,0 +1,34 @@
+#ifndef EVENT_CACHE_H
+#define EVENT_CACHE_H
+
+#include "TString.h"
+
+#include "Event.h"
+
+
+// On-disk cache of the decoded columns of an EventStore. Each
+// store is written into one binary file in the cache directory,
+// identified by a key that describes everything the columns depend
+// on (see EventBuilder). Cached stores are read back by memory-mapping
+// the file, which avoids reading the ROOT trees again.
+// The cache is disabled if the directory is empty.
+class EventCache {
+public:
+  EventCache(const TString &dir) : dir_(dir) {};
+
+  bool isEnabled() const { return dir_ != ""; }
+
+  // Fills the empty 'store' from the cache. Returns false if there
+  // is no (valid) cache file for 'key'.
+  bool read(const TString &key, EventStore &store) const;
+  void write(const TString &key, const EventStore &store) const;
+
+
+private:
+  static const char* magic_;
+
+  const TString dir_;
+
+  TString fileName(const TString &key) const;
+};
+#endif
@@ -0,0 +1,19 @@
+#ifndef EVENT_CONSUMER_H
+#define EVENT_CONSUMER_H
+
+class DataSet;
+
+
+// Accumulates information from the events of the datasets, e.g.
+// histograms. In streaming mode (see GlobalParameters::chunkSize()),
+// the events are read in chunks, and process() is called for each
+// chunk of each dataset with the events of that chunk in
+// DataSet::evtsBegin() ... DataSet::evtsEnd(). The events are
+// deleted afterwards.
+class EventConsumer {
+public:
+  virtual ~EventConsumer() {};
+
+  virtual void process(const DataSet* dataSet) = 0;
+};
+#endif
@@ -6,19 +6,75 @@
 #include <iostream>
 
 #include "EventInfoPrinter.h"
+#include "GlobalParameters.h"
+#include "Manifest.h"
 #include "Output.h"
+#include "Profiler.h"
 #include "Selection.h"
 #include "Variable.h"
 
 
-TString EventInfoPrinter::runSortVar_ = "";
+unsigned int EventInfoPrinter::runSortVar_ = 0;
+
+
+// Mark the variables needed for printing as used. All variables
+// are printed, hence all need to be read.
+void EventInfoPrinter::useVariables(const Config &cfg) {
+  if( cfg("print event info").size() > 0 ) {
+    for(std::vector<TString>::const_iterator it = Variable::begin();
+	it != Variable::end(); ++it) {
+      Variable::use(*it);
+    }
+  }
+}
 
 
 EventInfoPrinter::EventInfoPrinter(const Config &cfg)
-  : cfg_(cfg) {
+  : cfg_(cfg), key_(Manifest::key(cfg,"print event info")) {
+  isEnabled_ = init("print event info");
+  isUpToDate_ = isEnabled_ && Manifest::isUpToDate(key_);
+}
+
+
+EventInfoPrinter::~EventInfoPrinter() {
+  for(std::map<TString,EventStore*>::iterator it = candidates_.begin();
+      it != candidates_.end(); ++it) {
+    delete it->second;
+  }
+}
+
+
+// Copy the events of the current chunk that might be printed
+// to the candidates of this dataset
+void EventInfoPrinter::process(const DataSet* dataSet) {
+  if( !isEnabled_ || isUpToDate_ || !printSelection(dataSet->selectionUid()) ) return;
+  Profiler::Timer timer("EventInfoPrinter::process");
+
+  std::vector<Event> selectedEvts;
+  selectCandidates(dataSet->evtsBegin(),dataSet->evtsEnd(),selectedEvts);
+  if( selectedEvts.empty() ) return;
+  std::vector<unsigned int> idx;
+  for(std::vector<Event>::const_iterator it = selectedEvts.begin();
+      it != selectedEvts.end(); ++it) {
+    idx.push_back(it->index());
+  }
+  // Keep the order of the events in the input
+  std::sort(idx.begin(),idx.end());
+
+  EventStore* &store = candidates_[dataSet->uid()];
+  if( store == 0 ) store = new EventStore(std::vector<TString>(dataSet->systLabelsBegin(),dataSet->systLabelsEnd()));
+  const EventStore* chunk = dataSet->evtsBegin()->store();
+  for(std::vector<unsigned int>::const_iterator it = idx.begin(); it != idx.end(); ++it) {
+    store->append(*chunk,*it);
+  }
+}
 
-  // Init and run
-  if( init("print event info") ) {
+
+void EventInfoPrinter::run() {
+  if( isEnabled_ && isUpToDate_ ) {
+    std::cout << "  - Event-provenance information in " << outFileName_ << " is up to date" << std::endl;
+  } else if( isEnabled_ ) {
+    Profiler::Timer timer("EventInfoPrinter::run");
     // Print setup
     std::cout << "  - Writing event-provenance information to " << outFileName_ << std::endl;
     std::cout << "     - Printing " << std::flush;
@@ -42,6 +98,10 @@ EventInfoPrinter::EventInfoPrinter(const Config &cfg)
 
     selectEvents();
     print();
+    std::vector<TString> files;
+    files.push_back(outFileName_);
+    files.push_back(latexSlidesName_);
+    Manifest::update(key_,files);
   }
 }
 
@@ -68,7 +128,7 @@ bool EventInfoPrinter::init(const TString &key) {
 	      Variable::exists(varNameLumiBlockNum) &&
 	      Variable::exists(varNameEvtNum) ) {
 	    provVarsDefined = true;
-	    EventInfoPrinter::runSortVar_ = varNameRunNum;
+	    EventInfoPrinter::runSortVar_ = Variable::index(varNameRunNum);
 	    break;
 	  }
 	} else {
@@ -148,41 +208,17 @@ void EventInfoPrinter::selectEvents() {
   for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
     if( printSelection((*its)->uid()) ) {
       // Loop over all datasets with this global selection
-      DataSets selectedDataSets = DataSet::findAllWithSelection((*its)->uid());
+      DataSets selectedDataSets = DataSet::findAllWithSelection(*its);
       for(DataSetIt itsd = selectedDataSets.begin(); itsd != selectedDataSets.end(); ++itsd) {
-	// Select events accoridng to specification
-	std::vector<const Event*> selectedEvts;
-	if( printAllEvents() ) {	// select all events to print info
-	  for(EventIt itEvt = (*itsd)->evtsBegin(); itEvt != (*itsd)->evtsEnd(); ++itEvt) {
-	    selectedEvts.push_back(*itEvt);
-	  }
-	} else {			// select n (as specified) events with highest value of selection variable
-	  for(std::map<TString,unsigned int>::const_iterator itSV = selectionVariables_.begin();
-	      itSV != selectionVariables_.end(); ++itSV) {
-	
-	    std::vector<EvtValPair*> evtValPairs;
-	    for(EventIt itEvt = (*itsd)->evtsBegin(); itEvt != (*itsd)->evtsEnd(); ++itEvt) {
-	      evtValPairs.push_back(new EvtValPair(*itEvt,(*itEvt)->get(itSV->first)));
-	    }
-	    // sort by size of variable's values
-	    std::sort(evtValPairs.begin(),evtValPairs.end(),EvtValPair::valueGreaterThan);
-	    // store n (as specified) events with largest value
-	    for(unsigned int n = 0; 
-		n < std::min(itSV->second,static_cast<unsigned int>(evtValPairs.size())); ++n) {
-	      bool isNewEvt = true;
-	      for(std::vector<const Event*>::const_iterator it = selectedEvts.begin();
-		  it != selectedEvts.end(); ++it) {
-		if( (*it) == evtValPairs.at(n)->event() ) {
-		  isNewEvt = false;
-		  break;
-		}
-	      }
-	      if( isNewEvt ) selectedEvts.push_back(evtValPairs.at(n)->event());
-	    }
-	    for(std::vector<EvtValPair*>::iterator it = evtValPairs.begin();
-		it != evtValPairs.end(); ++it) {
-	      delete *it;
-	    }
+	// Select events accoridng to specification, in streaming
+	// mode from the candidates collected by process()
+	std::vector<Event> selectedEvts;
+	if( GlobalParameters::chunkSize() == 0 ) {
+	  selectCandidates((*itsd)->evtsBegin(),(*itsd)->evtsEnd(),selectedEvts);
+	} else {
+	  std::map<TString,EventStore*>::const_iterator itc = candidates_.find((*itsd)->uid());
+	  if( itc != candidates_.end() ) {
+	    selectCandidates(EventIt(itc->second,0),EventIt(itc->second,itc->second->size()),selectedEvts);
 	  }
 	}
 	// Sort by run
@@ -210,7 +246,7 @@ void EventInfoPrinter::print() const {
   // Print file with detailed event info and some formatting
   ofstream file(outFileName_);
   // txt-style table
-  for(std::map< TString, std::vector<const Event*> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
+  for(std::map< TString, std::vector<Event> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
     file << separator1 << std::endl;
     file << "Dataset: '" << it->first << "'" << std::endl;
     file << separator2 << std::endl;
@@ -221,7 +257,7 @@ void EventInfoPrinter::print() const {
     }
     file << separator2 << std::endl;
     
-    for(std::vector<const Event*>::const_iterator itEvt = it->second.begin();
+    for(std::vector<Event>::const_iterator itEvt = it->second.begin();
 	itEvt != it->second.end(); ++itEvt) {
       for(std::list<TString>::const_iterator itVar = vars.begin(); itVar != vars.end(); ++itVar) {
 	if( Variable::type(*itVar) == "UShort_t" ||
@@ -232,7 +268,7 @@ void EventInfoPrinter::print() const {
 	} else {
 	  file << std::setprecision(3);
 	}
-	file << std::setw(width) << (*itEvt)->get(*itVar);
+	file << std::setw(width) << itEvt->get(*itVar);
 	if( itVar != --vars.end() ) file << " : ";
 	else file << std::endl;
       }
@@ -241,7 +277,7 @@ void EventInfoPrinter::print() const {
     file << "\n\n\n";
   }
   // LaTeX-style table
-  for(std::map< TString, std::vector<const Event*> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
+  for(std::map< TString, std::vector<Event> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
     file << "\n\n\n%" << separator1 << std::endl;
     file << "% Dataset: '" << it->first << "'" << std::endl;
     file << "%" << separator2 << std::endl;
@@ -258,7 +294,7 @@ void EventInfoPrinter::print() const {
     }
     file << "\\midrule\n";
     
-    for(std::vector<const Event*>::const_iterator itEvt = it->second.begin();
+    for(std::vector<Event>::const_iterator itEvt = it->second.begin();
 	itEvt != it->second.end(); ++itEvt) {
       for(std::list<TString>::const_iterator itVar = vars.begin(); itVar != vars.end(); ++itVar) {
 	if( Variable::type(*itVar) == "UShort_t" ||
@@ -269,10 +305,10 @@ void EventInfoPrinter::print() const {
 	} else {
 	  file << std::setprecision(2);
 	}
-	if( (*itEvt)->get(*itVar) == 9999 ) {
+	if( itEvt->get(*itVar) == 9999 ) {
 	  file << std::setw(width) << "---";
 	} else {
-	  file << std::setw(width) << (*itEvt)->get(*itVar);
+	  file << std::setw(width) << itEvt->get(*itVar);
 	}
 	if( itVar != --vars.end() ) file << " & ";
 	else file << " \\\\ \n";
@@ -284,15 +320,15 @@ void EventInfoPrinter::print() const {
   file.close();
 
   // Print CMSSW-like run lists
-  for(std::map< TString, std::vector<const Event*> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
+  for(std::map< TString, std::vector<Event> >::const_iterator it = printedEvts_.begin(); it != printedEvts_.end(); ++it) {
     ofstream file(Output::resultDir()+"/"+Output::id()+"_EventInfo__"+Output::cleanName(it->first)+"__Runlist.txt");
-    for(std::vector<const Event*>::const_iterator itEvt = it->second.begin();
+    for(std::vector<Event>::const_iterator itEvt = it->second.begin();
 	itEvt != it->second.end(); ++itEvt) {
-      file << std::setw(width) << (*itEvt)->get(varNameRunNum);
+      file << std::setw(width) << itEvt->get(varNameRunNum);
       file << ":";
-      file << std::setw(width) << (*itEvt)->get(varNameLumiBlockNum);
+      file << std::setw(width) << itEvt->get(varNameLumiBlockNum);
       file << ":";
-      file << std::setw(width) << std::setprecision(15) << (*itEvt)->get(varNameEvtNum);
+      file << std::setw(width) << std::setprecision(15) << itEvt->get(varNameEvtNum);
       file << std::endl;
     }
     file.close();
@@ -301,22 +337,22 @@ void EventInfoPrinter::print() const {
 
   // LaTeX slides for event displays
   ofstream texFile(latexSlidesName_);
-  for(std::map< TString, std::vector<const Event*> >::const_iterator it = printedEvts_.begin();
+  for(std::map< TString, std::vector<Event> >::const_iterator it = printedEvts_.begin();
       it != printedEvts_.end(); ++it) {
-    for(std::vector<const Event*>::const_iterator itEvt = it->second.begin();
+    for(std::vector<Event>::const_iterator itEvt = it->second.begin();
 	itEvt != it->second.end(); ++itEvt) {
       texFile << "% --------------------------------------------------" << std::endl;
       texFile << "\\begin{frame}" << std::endl;
-      texFile << "\\frametitle{Event " << (*itEvt)->get(varNameRunNum) << ":" << (*itEvt)->get(varNameLumiBlockNum) << ":" << std::setprecision(15) << (*itEvt)->get(varNameEvtNum) << " (" << it->first << ")}" << std::endl; // (Name of dataset and selection)
+      texFile << "\\frametitle{Event " << itEvt->get(varNameRunNum) << ":" << itEvt->get(varNameLumiBlockNum) << ":" << std::setprecision(15) << itEvt->get(varNameEvtNum) << " (" << it->first << ")}" << std::endl; // (Name of dataset and selection)
 
       texFile << "  \\begin{columns}" << std::endl;
       texFile << "    \\begin{column}{0.55\\textwidth}" << std::endl;
       texFile << "      \\centering" << std::endl;
-      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << (*itEvt)->get(varNameRunNum) << "_" << std::setprecision(15) << (*itEvt)->get(varNameEvtNum) << "_" << (*itEvt)->get(varNameLumiBlockNum) << "_RhoPhi.png}" << std::endl;
+      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << itEvt->get(varNameRunNum) << "_" << std::setprecision(15) << itEvt->get(varNameEvtNum) << "_" << itEvt->get(varNameLumiBlockNum) << "_RhoPhi.png}" << std::endl;
       texFile << "    \\end{column}" << std::endl;
       texFile << "    \\begin{column}{0.45\\textwidth}" << std::endl;
-      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << (*itEvt)->get(varNameRunNum) << "_" << std::setprecision(15) << (*itEvt)->get(varNameEvtNum) << "_" << (*itEvt)->get(varNameLumiBlockNum) << "_Lego.png}\\\\" << std::endl;
-      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << (*itEvt)->get(varNameRunNum) << "_" << std::setprecision(15) << (*itEvt)->get(varNameEvtNum) << "_" << (*itEvt)->get(varNameLumiBlockNum) << "_RhoZ.png}" << std::endl;
+      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << itEvt->get(varNameRunNum) << "_" << std::setprecision(15) << itEvt->get(varNameEvtNum) << "_" << itEvt->get(varNameLumiBlockNum) << "_Lego.png}\\\\" << std::endl;
+      texFile << "      \\includegraphics[width=\\textwidth]{figures/ID-" << itEvt->get(varNameRunNum) << "_" << std::setprecision(15) << itEvt->get(varNameEvtNum) << "_" << itEvt->get(varNameLumiBlockNum) << "_RhoZ.png}" << std::endl;
       texFile << "    \\end{column}  " << std::endl;
       texFile << "  \\end{columns}" << std::endl;
       texFile << "\\end{frame}\n\n\n" << std::endl;
@@ -388,14 +424,49 @@ bool EventInfoPrinter::printSelection(const TString &uid) const {
 }
 
 
-bool EventInfoPrinter::EvtValPair::valueGreaterThan(const EvtValPair *idx1, const EvtValPair *idx2) {
-  if(idx1 == 0) {
-    return idx2 != 0;
-  } else if(idx2 == 0) {
-    return false;
-  } else {
-    return idx1->value() > idx2->value();
+// The events in [begin,end) to be printed: all events, or the
+// n (as specified) events with highest value of each selection
+// variable
+void EventInfoPrinter::selectCandidates(EventIt begin, EventIt end, std::vector<Event> &selectedEvts) const {
+  if( printAllEvents() ) {	// select all events to print info
+    for(EventIt itEvt = begin; itEvt != end; ++itEvt) {
+      selectedEvts.push_back(*itEvt);
+    }
+  } else {			// select n (as specified) events with highest value of selection variable
+    std::set<unsigned int> selectedIdx; // to skip events selected for several variables
+    std::vector<EvtValPair> highest;
+    for(std::map<TString,unsigned int>::const_iterator itSV = selectionVariables_.begin();
+	itSV != selectionVariables_.end(); ++itSV) {
+      selectHighest(begin,end,Variable::index(itSV->first),itSV->second,highest);
+      for(std::vector<EvtValPair>::const_iterator it = highest.begin();
+	  it != highest.end(); ++it) {
+	if( selectedIdx.insert(it->event().index()).second ) selectedEvts.push_back(it->event());
+      }
+    }
+  }
+}
+
+
+// The 'n' events in [begin,end) with the highest values of variable
+// 'varIdx', sorted by decreasing value. Keeps a heap of the n best
+// events so far, with the lowest of them on top, such that each
+// event is compared only to that one.
+void EventInfoPrinter::selectHighest(EventIt begin, EventIt end, unsigned int varIdx, unsigned int n, std::vector<EvtValPair> &highest) const {
+  highest.clear();
+  if( n == 0 ) return;
+  highest.reserve(n);
+  for(EventIt itEvt = begin; itEvt != end; ++itEvt) {
+    EvtValPair pair(*itEvt,itEvt->get(varIdx));
+    if( highest.size() < n ) {
+      highest.push_back(pair);
+      std::push_heap(highest.begin(),highest.end(),EvtValPair::valueGreaterThan);
+    } else if( EvtValPair::valueGreaterThan(pair,highest.front()) ) {
+      std::pop_heap(highest.begin(),highest.end(),EvtValPair::valueGreaterThan);
+      highest.back() = pair;
+      std::push_heap(highest.begin(),highest.end(),EvtValPair::valueGreaterThan);
+    }
   }
+  std::sort_heap(highest.begin(),highest.end(),EvtValPair::valueGreaterThan);
 }
 
 
@@ -13,25 +13,39 @@
 #include "Config.h"
 #include "DataSet.h"
 #include "Event.h"
+#include "EventConsumer.h"
 
-class EventInfoPrinter {
+// Writes the provenance information of the selected events. In
+// streaming mode, the candidate events of each chunk are copied by
+// process(), and run() selects the printed events from them.
+// In incremental mode, up-to-date information is not printed again.
+class EventInfoPrinter : public EventConsumer {
 public:
+  static void useVariables(const Config &cfg);
+
   EventInfoPrinter(const Config &cfg);
-  ~EventInfoPrinter() {};
+  ~EventInfoPrinter();
+
+  void process(const DataSet* dataSet);
+  void run();
 
 private:
-  static TString runSortVar_;
-  static bool greaterByRun(const Event* evt1, const Event* evt2) {
-    return evt1->get(EventInfoPrinter::runSortVar_) < evt2->get(EventInfoPrinter::runSortVar_);	
+  static unsigned int runSortVar_; // resolved index of run-number variable
+  static bool greaterByRun(const Event &evt1, const Event &evt2) {
+    return evt1.get(EventInfoPrinter::runSortVar_) < evt2.get(EventInfoPrinter::runSortVar_);	
   }
 
   const Config &cfg_;
+  bool isEnabled_;
+  TString key_;			// See Manifest
+  bool isUpToDate_;
 
   std::map< TString, unsigned int > selectionVariables_;
   std::set<TString> printedSelections_;
-  std::map< TString, std::vector<const Event*> > printedEvts_;
+  std::map< TString, std::vector<Event> > printedEvts_;
   TString outFileName_;
   TString latexSlidesName_;
+  std::map<TString,EventStore*> candidates_; // Streaming mode only
 
   bool init(const TString &key);
   void selectEvents();
@@ -43,19 +57,25 @@ private:
   // To sort evts according to one of their quantities
   class EvtValPair {
   public:
-    static bool valueGreaterThan(const EvtValPair *idx1, const EvtValPair *idx2);
+    // Larger value first; for equal values, the earlier event first
+    static bool valueGreaterThan(const EvtValPair &pair1, const EvtValPair &pair2) {
+      return pair1.val_ > pair2.val_ || ( pair1.val_ == pair2.val_ && pair1.evt_.index() < pair2.evt_.index() );
+    }
 
-    EvtValPair(const Event *evt, double value)
+    EvtValPair(const Event &evt, double value)
       : evt_(evt), val_(value) {}
 
-    const Event* event() const { return evt_; }
+    const Event& event() const { return evt_; }
     double value() const { return val_; }
 
   private:
-    const Event* evt_;
-    const double val_;
+    Event evt_;
+    double val_;
   };
 
+  void selectCandidates(EventIt begin, EventIt end, std::vector<Event> &selectedEvts) const;
+  void selectHighest(EventIt begin, EventIt end, unsigned int varIdx, unsigned int n, std::vector<EvtValPair> &highest) const;
+
   TString varNameNJets;
   TString varNameHT;
   TString varNameMHT;
@@ -10,7 +10,9 @@
 
 #include "DataSet.h"
 #include "EventYieldPrinter.h"
+#include "Manifest.h"
 #include "Output.h"
+#include "Profiler.h"
 #include "Selection.h"
 #include "Style.h"
 
@@ -18,8 +20,13 @@
 
 EventYieldPrinter::EventYieldPrinter() 
   : inputDataSets_(DataSet::findAllUnselected()) {
+  Profiler::Timer timer("EventYieldPrinter");
   
   const TString outFileNamePrefix = Output::resultDir()+"/"+Output::id();
+  if( Manifest::isUpToDate("event yields") ) {
+    std::cout << "  - Event-yield information and data card are up to date" << std::endl;
+    return;
+  }
   prepareSummaryTable();
 
   std::cout << "  - Writing event-yield information to '" << outFileNamePrefix << "_EventYields.tex'" << std::endl;
@@ -27,6 +34,10 @@ EventYieldPrinter::EventYieldPrinter()
 
   std::cout << "  - Writing data card to '" << outFileNamePrefix << "_DataCard.txt'" << std::endl;
   printDataCard(outFileNamePrefix+"_DataCard.txt");
+  std::vector<TString> files;
+  files.push_back(outFileNamePrefix+"_EventYields.tex");
+  files.push_back(outFileNamePrefix+"_DataCard.txt");
+  Manifest::update("event yields",files);
 
   printToScreen();
 }
@@ -72,7 +83,7 @@ void EventYieldPrinter::prepareSummaryTable() {
     tableRow.push_back((" "+(*its)->uid()+" "));
     tableRowLatex.clear();
     tableRowLatex.push_back((" "+Style::tlatexLabel((*its)->uid())+" "));
-    DataSets selectedDataSets = DataSet::findAllWithSelection((*its)->uid());
+    DataSets selectedDataSets = DataSet::findAllWithSelection(*its);
     char yield[50];
     char stat[50];
     char systDn[50];
@@ -280,7 +291,7 @@ void EventYieldPrinter::printToLaTeX(const TString &outFileName) const {
 
     for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
       file << std::setw(width) << Output::cleanLatexName((*its)->uid());      
-      const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+      const DataSet* selectedDataSet = DataSet::find(*itd,*its);
       char yield[50];
       char stat[50];
       char systDn[50];
@@ -350,7 +361,7 @@ void EventYieldPrinter::printDataCard(const TString &outFileName) const {
     file << (*itd)->label() << "_events = ";
     
     for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-      const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+      const DataSet* selectedDataSet = DataSet::find(*itd,*its);
       file << std::setw(width) << selectedDataSet->yield();
     }
     file << std::endl;
@@ -372,7 +383,7 @@ void EventYieldPrinter::printDataCard(const TString &outFileName) const {
       // print statistical uncertainties in each bin
       file << (*itd)->label() << "_uncertainty_1 = ";
       for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+	const DataSet* selectedDataSet = DataSet::find(*itd,*its);
 	file << std::setw(width) << selectedDataSet->stat();
       }
       file << std::endl;
@@ -380,13 +391,13 @@ void EventYieldPrinter::printDataCard(const TString &outFileName) const {
       if( (*itd)->hasSyst() ) {
 	file << (*itd)->label() << "_uncertaintyDN_2 = ";
 	for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	  const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+	  const DataSet* selectedDataSet = DataSet::find(*itd,*its);
 	  file << std::setw(width) << selectedDataSet->totSystDn() << " ";
 	}
 	file << std::endl;
 	file << (*itd)->label() << "_uncertaintyUP_2 = ";
 	for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	  const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+	  const DataSet* selectedDataSet = DataSet::find(*itd,*its);
 	  file << std::setw(width) << selectedDataSet->totSystUp() << " ";
 	}
 	file << std::endl;
@@ -414,7 +425,7 @@ void EventYieldPrinter::printDataCard(const TString &outFileName) const {
       file << (*itd)->label() << "_events = ";
       
       for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+	const DataSet* selectedDataSet = DataSet::find(*itd,*its);
 	file << std::setw(width) << selectedDataSet->yield();
       }
       file << std::endl;
@@ -436,24 +447,23 @@ void EventYieldPrinter::printDataCard(const TString &outFileName) const {
 	// print statistical uncertainties in each bin
 	file << (*itd)->label() << "_uncertainty_1 = ";
 	for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	  const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
+	  const DataSet* selectedDataSet = DataSet::find(*itd,*its);
 	  file << std::setw(width) << selectedDataSet->stat();
 	}
 	file << std::endl;
 	// print further uncertainties in each bin
 	unsigned int nUncert = 2;
-	for(std::vector<TString>::const_iterator itu = (*itd)->systLabelsBegin();
-	    itu != (*itd)->systLabelsEnd(); ++itu, ++nUncert) {
+	for(unsigned int i = 0; i < (*itd)->nSyst(); ++i, ++nUncert) {
 	  file << (*itd)->label() << "_uncertaintyDN_" << nUncert << " = ";
 	  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	    const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
-	    file << std::setw(width) << selectedDataSet->systDn(*itu) << " ";
+	    const DataSet* selectedDataSet = DataSet::find(*itd,*its);
+	    file << std::setw(width) << selectedDataSet->systDn(i) << " ";
 	  }
 	  file << std::endl;
 	  file << (*itd)->label() << "_uncertaintyUP_" << nUncert << " = ";
 	  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	    const DataSet* selectedDataSet = DataSet::find((*itd)->label(),*its);
-	    file << std::setw(width) << selectedDataSet->systUp(*itu) << " ";
+	    const DataSet* selectedDataSet = DataSet::find(*itd,*its);
+	    file << std::setw(width) << selectedDataSet->systUp(i) << " ";
 	  }
 	  file << std::endl;
 	}
@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
 
 #include "Filter.h"
+#include "FilterProgram.h"
 #include "Config.h"
 #include "Event.h"
 #include "GlobalParameters.h"
@@ -9,7 +11,10 @@
 #include "Variable.h"
 
 
+std::vector<char*> Filter::arena_;
+size_t Filter::arenaBlockUsed_ = 0;
 std::vector<Filter*> Filter::garbage_;
+std::map<TString,const Filter*> Filter::shared_;
 TString Filter::offset_ = "    ";
 
 
@@ -36,7 +41,7 @@ const Filter* Filter::create(const TString &expr, const std::vector<TString> &da
   // If this selection is only to be applied to specific datasets
   // create dataset filter
   if( firstIteration && !dataSetLabels.empty() ) {
-    filter = new FilterDataSet(create(expr,dataSetLabels,lineNum,false,label),dataSetLabels);
+    filter = share(new FilterDataSet(create(expr,dataSetLabels,lineNum,false,label),dataSetLabels));
   } else {
     TString cfg = cleanExpression(expr);
     if( GlobalParameters::debug() ) std::cout << "  Cleaned expr: '" << cfg << "'" << std::endl;
@@ -44,7 +49,7 @@ const Filter* Filter::create(const TString &expr, const std::vector<TString> &da
     // Check if whole expression is negated
     if( isNegated(cfg) ) {
       if( GlobalParameters::debug() ) std::cout << "  Negated expression: remember NOT" << std::endl;
-      filter = new FilterNOT(create(cfg,dataSetLabels,lineNum,false,""));
+      filter = share(new FilterNOT(create(cfg,dataSetLabels,lineNum,false,"")));
     } else {
 
       // Possibly, split expression
@@ -55,9 +60,9 @@ const Filter* Filter::create(const TString &expr, const std::vector<TString> &da
 	const Filter* filter1 = create(expr1,dataSetLabels,lineNum,false,"");
 	const Filter* filter2 = create(expr2,dataSetLabels,lineNum,false,"");
 	if( op == "AND" ) {
-	  filter = new FilterAND(filter1,filter2);
+	  filter = share(new FilterAND(filter1,filter2));
 	} else if( op == "OR" ) {
-	  filter = new FilterOR(filter1,filter2);
+	  filter = share(new FilterOR(filter1,filter2));
 	}
       } else {
 	// Loop over previously defined selections
@@ -65,12 +70,12 @@ const Filter* Filter::create(const TString &expr, const std::vector<TString> &da
 	for(SelectionIt itS = Selection::begin(); itS != Selection::end(); ++itS) {
 	  if( (*itS)->uid() == cfg ) { // A selection with this name exists; reuse it
 	    if( GlobalParameters::debug() ) std::cout << "    Reusing selection '" << cfg << "'" << std::endl;
-	    filter = (*itS)->filter();
+	    filter = share((*itS)->filter());
 	    break;
 	  }
 	}
 	if( filter == 0 ) {
-	  filter = Cut::create(cfg,lineNum);
+	  filter = share(Cut::create(cfg,lineNum));
 	}
       }
     }
@@ -273,14 +278,71 @@ bool Filter::isSplit(const TString &expr, TString &expr1, TString &expr2, TStrin
 
 
 
+// Returns the previously created filter with the same key as
+// 'filter', if any, such that structurally identical filters are
+// one node. Such a node that is evaluated more than once on the
+// events of a dataset gets a slot in the memo of FilterProgram, see
+// Selection::init(). The unused duplicate is deleted by clear().
+// ---------------------------------------------------------------
+const Filter* Filter::share(const Filter* filter) {
+  const TString key = filter->key();
+  if( key == "" ) return filter;
+
+  std::map<TString,const Filter*>::const_iterator it = shared_.find(key);
+  if( it == shared_.end() ) {
+    shared_[key] = filter;
+    return filter;
+  }
+  if( GlobalParameters::debug() ) std::cout << "    Sharing filter '" << it->second->uid() << "'" << std::endl;
+
+  return it->second;
+}
+
+
+// ---------------------------------------------------------------
+void Filter::countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const {
+  if( uses[this]++ == 0 ) order.push_back(this);
+}
+
+
+// Memory for a filter from the current block of the arena; a new
+// block is started if the filter does not fit anymore
+// ---------------------------------------------------------------
+void* Filter::operator new(size_t size) {
+  const size_t align = 2*sizeof(double);
+  size = ((size+align-1)/align)*align;
+  if( arena_.empty() || arenaBlockUsed_+size > arenaBlockSize_ ) {
+    arena_.push_back(static_cast<char*>(malloc(size > arenaBlockSize_ ? size : arenaBlockSize_)));
+    if( arena_.back() == 0 ) {
+      std::cerr << "\n\nERROR in Filter: cannot allocate memory" << std::endl;
+      exit(-1);
+    }
+    arenaBlockUsed_ = 0;
+  }
+  void* p = arena_.back()+arenaBlockUsed_;
+  arenaBlockUsed_ += size;
+
+  return p;
+}
+
+
 // Use this method to delete all existing selections
-// Reused selections are treated correctly
+// Reused selections are treated correctly. The memory of the
+// filters is released together with the blocks of the arena.
 // ---------------------------------------------------------------
 void Filter::clear() {
   for(std::vector<Filter*>::iterator it = garbage_.begin();
       it != garbage_.end(); ++it) {
-    delete *it;
+    (*it)->~Filter();
+  }
+  garbage_.clear();
+  shared_.clear();
+  for(std::vector<char*>::iterator it = arena_.begin();
+      it != arena_.end(); ++it) {
+    free(*it);
   }
+  arena_.clear();
+  arenaBlockUsed_ = 0;
 }
 
 
@@ -378,6 +440,9 @@ Cut* Cut::create(const TString &expr, unsigned int lineNum) {
     else if( op == ">=" ) cut = new CutLessEqualThanLessEqualThan(val2,var,val1);
   }
 
+  // The variable needs to be read from the input trees
+  if( cut ) Variable::use(cut->var_);
+
   return cut;
 }
 
@@ -387,6 +452,7 @@ Cut* Cut::create(const TString &expr, unsigned int lineNum) {
 CutGreaterThan::CutGreaterThan(const TString &var, double val)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" > ";
   uid_ += val_;
@@ -395,10 +461,17 @@ CutGreaterThan::CutGreaterThan(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutGreaterThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::GreaterThan,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutGreaterEqualThan::CutGreaterEqualThan(const TString &var, double val)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" >= ";
   uid_ += val_;
@@ -407,10 +480,17 @@ CutGreaterEqualThan::CutGreaterEqualThan(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutGreaterEqualThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::GreaterEqualThan,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutLessThan::CutLessThan(const TString &var, double val)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" < ";
   uid_ += val_;
@@ -419,10 +499,17 @@ CutLessThan::CutLessThan(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutLessThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::LessThan,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutLessEqualThan::CutLessEqualThan(const TString &var, double val)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" <= ";
   uid_ += val_;
@@ -431,10 +518,17 @@ CutLessEqualThan::CutLessEqualThan(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutLessEqualThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::LessEqualThan,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutEqual::CutEqual(const TString &var, double val)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" == ";
   uid_ += val_;
@@ -443,10 +537,17 @@ CutEqual::CutEqual(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutEqual::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::Equal,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutNotEqual::CutNotEqual(const TString &var, double val)
   : Cut("") { 
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val;
   uid_ = var_+" != ";
   uid_ += val_;
@@ -455,10 +556,17 @@ CutNotEqual::CutNotEqual(const TString &var, double val)
 }
 
 
+// ---------------------------------------------------------------
+void CutNotEqual::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::NotEqual,varIdx_,val_);
+}
+
+
 // ---------------------------------------------------------------
 CutLessThanLessThan::CutLessThanLessThan(double val1, const TString &var, double val2)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val1;
   val2_ = val2;
   uid_ = "";
@@ -471,18 +579,25 @@ CutLessThanLessThan::CutLessThanLessThan(double val1, const TString &var, double
 
 
 // ---------------------------------------------------------------
-bool CutLessThanLessThan::passes(const Event* evt, const TString &dataSetLabel) const {
-  double x = evt->get(var_);
+bool CutLessThanLessThan::passes(const Event &evt) const {
+  double x = evt.get(varIdx_);
   
   return x > val_ && x < val2_;
 }
 
 
+// ---------------------------------------------------------------
+void CutLessThanLessThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::LessThanLessThan,varIdx_,val_,val2_);
+}
+
+
 
 // ---------------------------------------------------------------
 CutLessEqualThanLessEqualThan::CutLessEqualThanLessEqualThan(double val1, const TString &var, double val2)
   : Cut("") {
   var_ = var;
+  varIdx_ = Variable::index(var_);
   val_ = val1;
   val2_ = val2;
   uid_ = "";
@@ -495,13 +610,19 @@ CutLessEqualThanLessEqualThan::CutLessEqualThanLessEqualThan(double val1, const
 
 
 // ---------------------------------------------------------------
-bool CutLessEqualThanLessEqualThan::passes(const Event* evt, const TString &dataSetLabel) const {
-  double x = evt->get(var_);
+bool CutLessEqualThanLessEqualThan::passes(const Event &evt) const {
+  double x = evt.get(varIdx_);
   
   return x >= val_ && x <= val2_;
 }
 
 
+// ---------------------------------------------------------------
+void CutLessEqualThanLessEqualThan::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::LessEqualThanLessEqualThan,varIdx_,val_,val2_);
+}
+
+
 
 // ---------------------------------------------------------------
 BooleanOperator::BooleanOperator(const Filter* filter1, const Filter* filter2, const TString &name)
@@ -531,6 +652,29 @@ TString BooleanOperator::printOut() const {
 }
 
 
+// Nested operators of the same kind are merged, e.g. the operands
+// of '(a AND b) AND c' are a, b, and c, unless they are shared and
+// hence memoized as a whole
+// ---------------------------------------------------------------
+void BooleanOperator::operands(std::vector<const Filter*> &ops, const Filter* keep, const FilterProgram* prog) const {
+  const Filter* filters[2] = { filter1_, filter2_ };
+  for(unsigned int i = 0; i < 2; ++i) {
+    const BooleanOperator* op = dynamic_cast<const BooleanOperator*>(filters[i]);
+    if( op != 0 && op != keep && op->name_ == name_ && ( prog == 0 || prog->memoSlot(op) < 0 ) ) op->operands(ops,keep,prog);
+    else ops.push_back(filters[i]);
+  }
+}
+
+
+// ---------------------------------------------------------------
+void BooleanOperator::countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const {
+  if( uses[this]++ > 0 ) return;
+  order.push_back(this);
+  filter1_->countUses(uses,order);
+  filter2_->countUses(uses,order);
+}
+
+
 // ---------------------------------------------------------------
 FilterAND::FilterAND(const Filter* filter1, const Filter* filter2)
   : BooleanOperator(filter1,filter2,"AND") {
@@ -539,9 +683,9 @@ FilterAND::FilterAND(const Filter* filter1, const Filter* filter2)
 
 
 // ---------------------------------------------------------------
-bool FilterAND::passes(const Event* evt, const TString &dataSetLabel) const {
-  if( filter1_->passes(evt,dataSetLabel) ) {
-    if( filter2_->passes(evt,dataSetLabel) ) {
+bool FilterAND::passes(const Event &evt) const {
+  if( filter1_->passes(evt) ) {
+    if( filter2_->passes(evt) ) {
       return true;
     } else {
       return false;
@@ -552,6 +696,44 @@ bool FilterAND::passes(const Event* evt, const TString &dataSetLabel) const {
 }
 
 
+// ---------------------------------------------------------------
+void FilterAND::compile(FilterProgram &prog) const {
+  std::vector<const Filter*> ops;
+  operands(ops,0,&prog);
+  prog.compile(ops,FilterProgram::And);
+}
+
+
+// ---------------------------------------------------------------
+const Filter* FilterAND::specialize(const TString &dataSetLabel) const {
+  const Filter* filter1 = filter1_->specialize(dataSetLabel);
+  const Filter* filter2 = filter2_->specialize(dataSetLabel);
+  if( filter1->isTrue() ) return filter2;
+  if( filter2->isTrue() ) return filter1;
+  if( filter1 == filter1_ && filter2 == filter2_ ) return this;
+
+  return share(new FilterAND(filter1,filter2));
+}
+
+
+// ---------------------------------------------------------------
+// The residual is the AND of the other operands of the chain
+bool FilterAND::refines(const Filter* filter, const Filter* &residual) const {
+  std::vector<const Filter*> ops;
+  operands(ops,filter);
+  std::vector<const Filter*>::iterator it = std::find(ops.begin(),ops.end(),filter);
+  if( it == ops.end() ) return false;
+  ops.erase(it);
+
+  residual = ops.front();
+  for(unsigned int i = 1; i < ops.size(); ++i) {
+    residual = share(new FilterAND(residual,ops[i]));
+  }
+
+  return true;
+}
+
+
 // ---------------------------------------------------------------
 FilterOR::FilterOR(const Filter* filter1, const Filter* filter2)
   : BooleanOperator(filter1,filter2,"OR") {
@@ -560,10 +742,10 @@ FilterOR::FilterOR(const Filter* filter1, const Filter* filter2)
 
 
 // ---------------------------------------------------------------
-bool FilterOR::passes(const Event* evt, const TString &dataSetLabel) const {
-  if( filter1_->passes(evt,dataSetLabel) ) {
+bool FilterOR::passes(const Event &evt) const {
+  if( filter1_->passes(evt) ) {
     return true;
-  } else if( filter2_->passes(evt,dataSetLabel) ) {
+  } else if( filter2_->passes(evt) ) {
     return true;
   } else {
     return false;
@@ -571,6 +753,26 @@ bool FilterOR::passes(const Event* evt, const TString &dataSetLabel) const {
 }
 
 
+// ---------------------------------------------------------------
+void FilterOR::compile(FilterProgram &prog) const {
+  std::vector<const Filter*> ops;
+  operands(ops,0,&prog);
+  prog.compile(ops,FilterProgram::Or);
+}
+
+
+// ---------------------------------------------------------------
+const Filter* FilterOR::specialize(const TString &dataSetLabel) const {
+  const Filter* filter1 = filter1_->specialize(dataSetLabel);
+  if( filter1->isTrue() ) return filter1;
+  const Filter* filter2 = filter2_->specialize(dataSetLabel);
+  if( filter2->isTrue() ) return filter2;
+  if( filter1 == filter1_ && filter2 == filter2_ ) return this;
+
+  return share(new FilterOR(filter1,filter2));
+}
+
+
 // ---------------------------------------------------------------
 FilterNOT::FilterNOT(const Filter* filter)
   : Filter("NOT["+filter->uid()+"]"), filter_(filter) {
@@ -578,15 +780,40 @@ FilterNOT::FilterNOT(const Filter* filter)
 }
 
 
+// ---------------------------------------------------------------
+void FilterNOT::compile(FilterProgram &prog) const {
+  prog.compile(filter_);
+  prog.add(FilterProgram::Not);
+}
+
+
+// ---------------------------------------------------------------
+void FilterNOT::countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const {
+  if( uses[this]++ > 0 ) return;
+  order.push_back(this);
+  filter_->countUses(uses,order);
+}
+
+
+// ---------------------------------------------------------------
+const Filter* FilterNOT::specialize(const TString &dataSetLabel) const {
+  const Filter* filter = filter_->specialize(dataSetLabel);
+
+  return filter == filter_ ? this : share(new FilterNOT(filter));
+}
+
+
 // ---------------------------------------------------------------
 FilterDataSet::FilterDataSet(const Filter* filter, const std::vector<TString> &applyToDataSets)
   : Filter("FilterDataSet"), filter_(filter), applyToDataSets_(applyToDataSets) {
-  if( GlobalParameters::debug() ) std::cout << "    FilterDataSet::FilterDataSet() (" << applyToDataSets_.front() << std::flush;
-  for(std::vector<TString>::const_iterator it = applyToDataSets_.begin()+1;
-      it != applyToDataSets_.end(); ++it) {
-    std::cout << ", " << *it;
+  if( GlobalParameters::debug() ) {
+    std::cout << "    FilterDataSet::FilterDataSet() (" << applyToDataSets_.front() << std::flush;
+    for(std::vector<TString>::const_iterator it = applyToDataSets_.begin()+1;
+	it != applyToDataSets_.end(); ++it) {
+      std::cout << ", " << *it;
+    }
+    std::cout << ")" << std::endl;
   }
-  std::cout << ")" << std::endl;
 }
 
 
@@ -607,17 +834,34 @@ TString FilterDataSet::printOut() const {
 
 
 // ---------------------------------------------------------------
-bool FilterDataSet::passes(const Event* evt, const TString &dataSetLabel) const {
-  bool applyFilter = false;
-  for(std::vector<TString>::const_iterator it = applyToDataSets_.begin();
-      it != applyToDataSets_.end(); ++it) {
-    if( *it == dataSetLabel ) {
-      applyFilter = true;
-      break;
-    }
+const Filter* FilterDataSet::specialize(const TString &dataSetLabel) const {
+  if( std::find(applyToDataSets_.begin(),applyToDataSets_.end(),dataSetLabel) != applyToDataSets_.end() ) {
+    return filter_->specialize(dataSetLabel);
   }
 
-  return applyFilter ? filter_->passes(evt,dataSetLabel) : true;
+  return share(new FilterTRUE());
+}
+
+
+// Only specialized filters, which contain no FilterDataSet, are
+// evaluated
+// ---------------------------------------------------------------
+bool FilterDataSet::passes(const Event &evt) const {
+  std::cerr << "\n\nERROR in FilterDataSet::passes(): filter has not been specialized to a dataset" << std::endl;
+  exit(-1);
+
+  return false;
 }
 
 
+// ---------------------------------------------------------------
+void FilterDataSet::compile(FilterProgram &prog) const {
+  std::cerr << "\n\nERROR in FilterDataSet::compile(): filter has not been specialized to a dataset" << std::endl;
+  exit(-1);
+}
+
+
+// ---------------------------------------------------------------
+void FilterTRUE::compile(FilterProgram &prog) const {
+  prog.add(FilterProgram::True);
+}
@@ -1,24 +1,51 @@
 #ifndef FILTER_H
 #define FILTER_H
 
+#include <cstddef>
+#include <map>
 #include <vector>
 
 #include "TString.h"
 
 #include "Config.h"
+#include "CutKernel.h"
 #include "Event.h"
 
+class FilterProgram;
+
 
 class Filter {
 public:
   static const Filter* create(const TString &expr, const std::vector<TString> &dataSetLabels, unsigned int lineNum, const TString &label) { return create(expr,dataSetLabels,lineNum,true,label); }
   static void clear();
 
+  // Filters are allocated in blocks of an arena owned by the class
+  // and are released all together by clear()
+  static void* operator new(size_t size);
+  static void operator delete(void* p) {};
+
   Filter(const TString &uid) : uid_(uid) { garbage_.push_back(this); }
   virtual ~Filter() {};
 
   virtual TString printOut() const = 0;
-  virtual bool passes(const Event* evt, const TString &dataSetLabel) const = 0;
+  virtual bool passes(const Event &evt) const = 0;
+  // Appends the instructions of this filter to 'prog', see FilterProgram
+  virtual void compile(FilterProgram &prog) const = 0;
+  // This filter for the dataset 'dataSetLabel': the FilterDataSet
+  // nodes are replaced by their filter or by FilterTRUE, and TRUE
+  // operands of AND and OR are folded. Unchanged subtrees are shared.
+  virtual const Filter* specialize(const TString &dataSetLabel) const = 0;
+  virtual bool isTrue() const { return false; }
+  // Whether this filter is 'filter AND residual', with 'filter' any
+  // operand of a chain of ANDs; if so, 'residual' is set
+  virtual bool refines(const Filter* filter, const Filter* &residual) const { return false; }
+  // Identifies structurally identical filters, see share(); filters
+  // with an empty key are not shared
+  virtual TString key() const { return ""; }
+  // Counts the uses of this filter and of its operands, which are
+  // evaluated only for the first use; 'order' are the filters in the
+  // order of their first use
+  virtual void countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const;
 
   TString uid() const { return uid_; }
 
@@ -27,12 +54,17 @@ protected:
   static TString offset_;
 
   static TString cleanExpression(const TString &expr);
+  static const Filter* share(const Filter* filter);
 
   TString uid_;
 
 
 private:
+  static const size_t arenaBlockSize_ = 65536;
+  static std::vector<char*> arena_;
+  static size_t arenaBlockUsed_;	// Bytes used in the last block
   static std::vector<Filter*> garbage_;
+  static std::map<TString,const Filter*> shared_;	// By key()
 
   static const Filter* create(const TString &expr, const std::vector<TString> &dataSetLabels, unsigned int lineNum, bool firstIteration, const TString &label);
   static void checkForDanglingOperators(const TString &expr, unsigned int lineNum);
@@ -47,16 +79,24 @@ class Cut : public Filter {
 public:
   static Cut* create(const TString &expr, unsigned int lineNum);
 
-  Cut(const TString &uid) : Filter(uid) {};
+  Cut(const TString &uid) : Filter(uid), val2_(0.) {};
   virtual ~Cut() {};
 
   TString printOut() const { return offset_+"|-- "+uid(); }
-  virtual bool passes(const Event* evt, const TString &dataSetLabel) const = 0;
+  virtual bool passes(const Event &evt) const = 0;
+  const Filter* specialize(const TString &dataSetLabel) const { return this; }
+  // Batch version: sets mask[i] to 1 if the value x[i] of var()
+  // passes the cut and to 0 otherwise, see CutKernel
+  virtual void passes(const double* x, unsigned int n, unsigned char* mask) const = 0;
+  unsigned int var() const { return varIdx_; }
+  TString key() const { return TString::Format("%s %.17g %.17g",uid().Data(),val_,val2_); }
 
 
 protected:
   TString var_;
+  unsigned int varIdx_;		// resolved index of var_, see Variable::index()
   double val_;
+  double val2_;			// Upper value of two-sided cuts
 };
 
 
@@ -64,7 +104,9 @@ class CutGreaterThan : public Cut {
 public:
   CutGreaterThan(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) > val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) > val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::greaterThan(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -72,7 +114,9 @@ class CutGreaterEqualThan : public Cut {
 public:
   CutGreaterEqualThan(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) >= val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) >= val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::greaterEqualThan(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -80,7 +124,9 @@ class CutLessThan : public Cut {
 public:
   CutLessThan(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) < val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) < val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::lessThan(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -88,7 +134,9 @@ class CutLessEqualThan : public Cut {
 public:
   CutLessEqualThan(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) <= val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) <= val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::lessEqualThan(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -96,7 +144,9 @@ class CutEqual : public Cut {
 public:
   CutEqual(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) == val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) == val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::equal(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -104,7 +154,9 @@ class CutNotEqual : public Cut {
 public:
   CutNotEqual(const TString &var, double val);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return evt->get(var_) != val_; }
+  bool passes(const Event &evt) const { return evt.get(varIdx_) != val_; }
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::notEqual(x,n,val_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -112,10 +164,9 @@ class CutLessThanLessThan : public Cut {
 public:
   CutLessThanLessThan(double val1, const TString &var, double val2);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const;
-
-private:
-  double val2_;
+  bool passes(const Event &evt) const;
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::lessThanLessThan(x,n,val_,val2_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -123,10 +174,9 @@ class CutLessEqualThanLessEqualThan : public Cut {
 public:
   CutLessEqualThanLessEqualThan(double val1, const TString &var, double val2);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const;
-
-private:
-  double val2_;
+  bool passes(const Event &evt) const;
+  void passes(const double* x, unsigned int n, unsigned char* mask) const { CutKernel::lessEqualThanLessEqualThan(x,n,val_,val2_,mask); }
+  void compile(FilterProgram &prog) const;
 };
 
 
@@ -135,13 +185,19 @@ public:
   BooleanOperator(const Filter* filter1, const Filter* filter2, const TString &name);
 
   TString printOut() const;
-  virtual bool passes(const Event* evt, const TString &dataSetLabel) const = 0;
+  virtual bool passes(const Event &evt) const = 0;
+  TString key() const { return TString::Format("%s %p %p",name_.Data(),static_cast<const void*>(filter1_),static_cast<const void*>(filter2_)); }
+  void countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const;
   
 
 protected:
   const Filter* filter1_;
   const Filter* filter2_;
 
+  // The operands, in which nested operators of the same kind are
+  // merged, except 'keep' and those memoized by 'prog'
+  void operands(std::vector<const Filter*> &ops, const Filter* keep = 0, const FilterProgram* prog = 0) const;
+
 
 private:
   TString name_;
@@ -152,7 +208,10 @@ class FilterAND : public BooleanOperator {
 public:
   FilterAND(const Filter* filter1, const Filter* filter2);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const;
+  bool passes(const Event &evt) const;
+  void compile(FilterProgram &prog) const;
+  const Filter* specialize(const TString &dataSetLabel) const;
+  bool refines(const Filter* filter, const Filter* &residual) const;
 };
 
 
@@ -160,7 +219,9 @@ class FilterOR : public BooleanOperator {
 public:
   FilterOR(const Filter* filter1, const Filter* filter2);
 
-  bool passes(const Event* evt, const TString &dataSetLabel) const;
+  bool passes(const Event &evt) const;
+  void compile(FilterProgram &prog) const;
+  const Filter* specialize(const TString &dataSetLabel) const;
 };
 
 
@@ -169,7 +230,11 @@ public:
   FilterNOT(const Filter* filter);
 
   TString printOut() const { return offset_+"|-- "+uid(); }
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return !(filter_->passes(evt,dataSetLabel)); }
+  bool passes(const Event &evt) const { return !(filter_->passes(evt)); }
+  void compile(FilterProgram &prog) const;
+  const Filter* specialize(const TString &dataSetLabel) const;
+  TString key() const { return TString::Format("NOT %p",static_cast<const void*>(filter_)); }
+  void countUses(std::map<const Filter*,unsigned int> &uses, std::vector<const Filter*> &order) const;
 
 
 private:
@@ -183,18 +248,25 @@ public:
   FilterTRUE() : Filter("FilterTRUE") {};
   
   TString printOut() const { return offset_+"TRUE"; }
-  bool passes(const Event* evt, const TString &dataSetLabel) const { return true; }
+  bool passes(const Event &evt) const { return true; }
+  void compile(FilterProgram &prog) const;
+  const Filter* specialize(const TString &dataSetLabel) const { return this; }
+  bool isTrue() const { return true; }
+  TString key() const { return "TRUE"; }
 };
 
 
 // Returns true for all but the specified datasets
-// Otherwise apply cuts
+// Otherwise apply cuts. The dataset is resolved by
+// specialize() before any event is processed.
 class FilterDataSet : public Filter {
 public:
   FilterDataSet(const Filter* filter, const std::vector<TString> &applyToDataSets);
   
   TString printOut() const;
-  bool passes(const Event* evt, const TString &dataSetLabel) const;
+  bool passes(const Event &evt) const;
+  void compile(FilterProgram &prog) const;
+  const Filter* specialize(const TString &dataSetLabel) const;
 
   
 private:
@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+
+#include "CutKernel.h"
+#include "Filter.h"
+#include "FilterProgram.h"
+#include "Variable.h"
+
+
+const unsigned int FilterProgram::blockSize_;
+const unsigned int FilterProgram::nSamples_;
+bool FilterProgram::isSampling_ = false;
+std::map<const Filter*,FilterProgram::Statistics> FilterProgram::statistics_;
+
+FilterProgram::FilterProgram(const Filter* filter, const Slots* slots)
+  : filter_(filter), slots_(slots), depth_(0), maxDepth_(0) {
+  compile(filter);
+}
+
+
+int FilterProgram::memoSlot(const Filter* filter) const {
+  if( slots_ == 0 ) return -1;
+  Slots::const_iterator it = slots_->find(filter);
+
+  return it != slots_->end() ? static_cast<int>(it->second) : -1;
+}
+
+
+void FilterProgram::reorder() {
+  code_.clear();
+  samples_.clear();
+  reorderings_.clear();
+  depth_ = 0;
+  maxDepth_ = 0;
+  compile(filter_);
+}
+
+
+// Appends the instructions of 'filter'. Those of a shared filter
+// are skipped if its result for the block is already in the memo.
+// While sampling, all filters are evaluated.
+void FilterProgram::compile(const Filter* filter) {
+  const int slot = memoSlot(filter);
+  if( slot < 0 || isSampling_ ) {
+    filter->compile(*this);
+  } else {
+    unsigned int load = add(Load,slot);
+    filter->compile(*this);
+    add(Store,slot);
+    setJumpTarget(load);
+  }
+}
+
+
+// Appends the AND or OR of the operands. The next operand is
+// skipped for blocks of events in which the previous ones already
+// decide the result. While sampling, all operands are evaluated
+// and their pass rates are recorded.
+void FilterProgram::compile(const std::vector<const Filter*> &operands, OpCode op) {
+  std::vector<const Filter*> ordered = operands;
+  if( !isSampling_ ) order(ordered,op);
+  std::vector<unsigned int> jumps;
+  for(unsigned int i = 0; i < ordered.size(); ++i) {
+    const unsigned int first = code_.size();
+    compile(ordered[i]);
+    if( isSampling_ ) {
+      Statistics &stats = statistics_[ordered[i]];
+      stats.cost_ = 0;
+      for(unsigned int pc = first; pc < code_.size(); ++pc) {
+	if( code_[pc].op_ <= LessEqualThanLessEqualThan ) ++stats.cost_;
+      }
+      add(Sample,samples_.size());
+      samples_.push_back(&stats);
+    }
+    if( i > 0 ) add(op);
+    if( !isSampling_ && i+1 < ordered.size() ) jumps.push_back(add(op == And ? JumpIfNone : JumpIfAll));
+  }
+  for(std::vector<unsigned int>::const_iterator it = jumps.begin();
+      it != jumps.end(); ++it) {
+    setJumpTarget(*it);
+  }
+}
+
+
+// Sorts the operands by their rank, see above. The order is kept
+// if not all operands have been sampled.
+void FilterProgram::order(std::vector<const Filter*> &operands, OpCode op) {
+  std::vector< std::pair<double,unsigned int> > ranks;
+  for(unsigned int i = 0; i < operands.size(); ++i) {
+    std::map<const Filter*,Statistics>::const_iterator it = statistics_.find(operands[i]);
+    if( it == statistics_.end() || it->second.nEvents_ == 0 ) return;
+    const double decides = op == And ? 1.-it->second.passRate() : it->second.passRate();
+    ranks.push_back(std::make_pair(decides > 0. ? it->second.cost_/decides : DBL_MAX,i));
+  }
+  std::sort(ranks.begin(),ranks.end());
+
+  std::vector<const Filter*> ordered;
+  for(unsigned int i = 0; i < ranks.size(); ++i) {
+    ordered.push_back(operands.at(ranks[i].second));
+  }
+  if( ordered == operands ) return;
+
+  const TString name = op == And ? " AND " : " OR ";
+  TString reordering = "";
+  for(unsigned int i = 0; i < operands.size(); ++i) {
+    if( i > 0 ) reordering += name;
+    reordering += "["+operands[i]->uid()+"]";
+  }
+  reordering += "  ->  ";
+  for(unsigned int i = 0; i < ordered.size(); ++i) {
+    if( i > 0 ) reordering += name;
+    reordering += "["+ordered[i]->uid()+"]";
+  }
+  reorderings_.push_back(reordering);
+  operands = ordered;
+}
+
+
+unsigned int FilterProgram::add(OpCode op, unsigned int var, double val1, double val2) {
+  int nPushed = 0;
+  if( op == And || op == Or ) nPushed = -1;
+  else if( op == Not || op == JumpIfNone || op == JumpIfAll || op == Load || op == Store || op == Sample ) nPushed = 0;
+  else nPushed = 1;
+  push(Instruction(op,var,val1,val2),nPushed);
+
+  return code_.size()-1;
+}
+
+
+void FilterProgram::push(const Instruction &instr, int nPushed) {
+  code_.push_back(instr);
+  depth_ += nPushed;
+  if( depth_ > maxDepth_ ) maxDepth_ = depth_;
+}
+
+
+void FilterProgram::run(const EventStore &store, unsigned int begin, unsigned int end, EventMask &mask, const EventMask* subset, Memo* memo) const {
+  if( begin >= end ) return;
+
+  // Stack of masks, one block each. Each mask is set before it is
+  // read, hence the stack of the memo need not be cleared.
+  std::vector<unsigned char> ownStack;
+  std::vector<unsigned char> &stack = memo != 0 ? memo->stack_ : ownStack;
+  if( stack.size() < (maxDepth_+1)*blockSize_ ) stack.resize((maxDepth_+1)*blockSize_,0);
+
+  for(unsigned int start = begin; start < end; start += blockSize_) {
+    const unsigned int n = std::min(blockSize_,end-start);
+    if( subset != 0 && subset->next(start) >= start+n ) continue;
+    unsigned int sp = 0;	// Number of masks on the stack
+    unsigned int pc = 0;
+    while( pc < code_.size() ) {
+      const Instruction &instr = code_[pc];
+      unsigned char* below = sp > 1 ? &(stack[(sp-2)*blockSize_]) : 0;
+      unsigned char* top = sp > 0 ? &(stack[(sp-1)*blockSize_]) : 0;
+      unsigned char* next = &(stack[sp*blockSize_]);
+      const double* x = 0;
+      if( instr.op_ <= LessEqualThanLessEqualThan ) x = &(store.column(instr.var_)[start]);
+      const double v1 = instr.val1_;
+      const double v2 = instr.val2_;
+
+      bool jump = false;
+      switch( instr.op_ ) {
+      case GreaterThan:
+	CutKernel::greaterThan(x,n,v1,next);
+	++sp;
+	break;
+      case GreaterEqualThan:
+	CutKernel::greaterEqualThan(x,n,v1,next);
+	++sp;
+	break;
+      case LessThan:
+	CutKernel::lessThan(x,n,v1,next);
+	++sp;
+	break;
+      case LessEqualThan:
+	CutKernel::lessEqualThan(x,n,v1,next);
+	++sp;
+	break;
+      case Equal:
+	CutKernel::equal(x,n,v1,next);
+	++sp;
+	break;
+      case NotEqual:
+	CutKernel::notEqual(x,n,v1,next);
+	++sp;
+	break;
+      case LessThanLessThan:
+	CutKernel::lessThanLessThan(x,n,v1,v2,next);
+	++sp;
+	break;
+      case LessEqualThanLessEqualThan:
+	CutKernel::lessEqualThanLessEqualThan(x,n,v1,v2,next);
+	++sp;
+	break;
+      case True:
+	std::fill(next,next+n,1);
+	++sp;
+	break;
+      case Not:
+	for(unsigned int i = 0; i < n; ++i) top[i] = !top[i];
+	break;
+      case And:
+	for(unsigned int i = 0; i < n; ++i) below[i] &= top[i];
+	--sp;
+	break;
+      case Or:
+	for(unsigned int i = 0; i < n; ++i) below[i] |= top[i];
+	--sp;
+	break;
+      case JumpIfNone:
+	jump = std::find(top,top+n,1) == top+n;
+	break;
+      case JumpIfAll:
+	jump = std::find(top,top+n,0) == top+n;
+	break;
+      case Load:
+	if( memo != 0 && instr.var_ < memo->blocks_.size() && memo->blocks_[instr.var_] == start+1 ) {
+	  const unsigned char* stored = &(memo->masks_[instr.var_*blockSize_]);
+	  std::copy(stored,stored+n,next);
+	  ++sp;
+	  jump = true;
+	}
+	break;
+      case Store:
+	if( memo != 0 ) {
+	  if( instr.var_ >= memo->blocks_.size() ) {
+	    memo->blocks_.resize(instr.var_+1,0);
+	    memo->masks_.resize((instr.var_+1)*blockSize_,0);
+	  }
+	  std::copy(top,top+n,&(memo->masks_[instr.var_*blockSize_]));
+	  memo->blocks_[instr.var_] = start+1;
+	}
+	break;
+      case Sample:
+	for(unsigned int i = 0; i < n; ++i) {
+	  if( subset == 0 || subset->test(start+i) ) {
+	    ++(samples_[instr.var_]->nEvents_);
+	    if( top[i] ) ++(samples_[instr.var_]->nPassed_);
+	  }
+	}
+	break;
+      }
+      pc = jump ? instr.target_ : pc+1;
+    }
+
+    // Result is the only mask on the stack
+    for(unsigned int i = 0; i < n; ++i) {
+      if( stack[i] && ( subset == 0 || subset->test(start+i) ) ) mask.set(start+i);
+    }
+  }
+}
+
+
+// Listing of the instructions, e.g. for debugging
+TString FilterProgram::printOut() const {
+  const char* names[] = { ">", ">=", "<", "<=", "==", "!=", "< x <", "<= x <=", "TRUE", "NOT", "AND", "OR", "JUMP IF NONE", "JUMP IF ALL", "LOAD", "STORE", "SAMPLE" };
+  TString txt = "";
+  for(unsigned int pc = 0; pc < code_.size(); ++pc) {
+    const Instruction &instr = code_[pc];
+    txt += "    ";
+    txt += pc;
+    txt += ": ";
+    txt += names[instr.op_];
+    if( instr.op_ <= LessEqualThanLessEqualThan ) {
+      txt += " "+(*(Variable::begin()+instr.var_))+" ";
+      txt += instr.val1_;
+      if( instr.op_ >= LessThanLessThan ) {
+	txt += " ";
+	txt += instr.val2_;
+      }
+    } else if( instr.op_ == Store || instr.op_ == Sample ) {
+      txt += " ";
+      txt += instr.var_;
+    } else if( instr.op_ >= JumpIfNone ) {
+      if( instr.op_ == Load ) {
+	txt += " ";
+	txt += instr.var_;
+      }
+      txt += " -> ";
+      txt += instr.target_;
+    }
+    txt += "\n";
+  }
+
+  return txt;
+}
@@ -0,0 +1,123 @@
+#ifndef FILTER_PROGRAM_H
+#define FILTER_PROGRAM_H
+
+#include <map>
+#include <vector>
+
+#include "TString.h"
+
+#include "Event.h"
+
+class Filter;
+
+
+// Flat, compiled version of a Filter tree. The program is a stack
+// machine in postfix order that evaluates the filter on blocks of
+// events at once: each cut pushes the comparison mask of one column
+// block onto the stack, and the boolean operators combine the masks.
+// AND and OR skip their second operand if the first one already
+// decides the result for the whole block. The result of a filter
+// used more than once (see Filter::share()) is stored in a memo
+// and loaded by the other programs run on the same block.
+//
+// In the adaptive mode ('global :: adaptive cut order: true'), the
+// programs compiled while sampling evaluate all operands of AND and
+// OR and record their pass rates. After reorder(), the operands of
+// an AND are evaluated in the order of ascending cost/(1 - pass rate)
+// and those of an OR of ascending cost/(pass rate), i.e. the cheapest
+// operand that most often decides the result comes first. The cost
+// is the number of comparisons of the operand.
+class FilterProgram {
+public:
+  enum OpCode { GreaterThan, GreaterEqualThan, LessThan, LessEqualThan, Equal, NotEqual, LessThanLessThan, LessEqualThanLessEqualThan, True, Not, And, Or, JumpIfNone, JumpIfAll, Load, Store, Sample };
+
+  // Results of the shared filters for the current block of events
+  // of one EventStore, and the stack of the programs run on it
+  class Memo {
+    friend class FilterProgram;
+
+  public:
+    Memo() {};
+
+  private:
+    std::vector<unsigned char> masks_;	// One block per memo slot
+    std::vector<unsigned int> blocks_;	// First event of the stored block + 1; 0: none
+    std::vector<unsigned char> stack_;	// Sized for the deepest program
+  };
+
+  // Operand of AND or OR on the sampled events
+  class Statistics {
+  public:
+    Statistics() : cost_(0), nEvents_(0), nPassed_(0) {};
+
+    double passRate() const { return nEvents_ > 0 ? static_cast<double>(nPassed_)/nEvents_ : 0.; }
+
+    unsigned int cost_;
+    ULong64_t nEvents_;
+    ULong64_t nPassed_;
+  };
+
+  static const unsigned int blockSize_ = 1024;
+  static const unsigned int nSamples_ = 64*blockSize_;
+
+  static void setSampling(bool isSampling) { isSampling_ = isSampling; }
+  static bool isSampling() { return isSampling_; }
+  static const std::map<const Filter*,Statistics>& statistics() { return statistics_; }
+
+  // Memo slots of the filters evaluated more than once by the
+  // programs run together, see Selection::init()
+  typedef std::map<const Filter*,unsigned int> Slots;
+
+  // The filter has to be specialized to a dataset, see Filter::specialize()
+  FilterProgram(const Filter* filter, const Slots* slots = 0);
+
+  // Sets the bits of the events in [begin,end) that pass the filter.
+  // If 'subset' is given, only the events set in 'subset' can pass,
+  // and blocks without such events are skipped. If 'memo' is given,
+  // the results of shared filters are reused; the programs using
+  // the same memo have to be run on the same blocks of 'store'; its
+  // stack is reused by all calls.
+  void run(const EventStore &store, unsigned int begin, unsigned int end, EventMask &mask, const EventMask* subset = 0, Memo* memo = 0) const;
+  TString printOut() const;
+  // The memo slot of 'filter', or -1
+  int memoSlot(const Filter* filter) const;
+  // Compiles the filter again, after the sampling in the learned order
+  void reorder();
+  // The changed orders of operands, e.g. "[a] AND [b]  ->  [b] AND [a]"
+  const std::vector<TString>& reorderings() const { return reorderings_; }
+
+  // Used by Filter::compile()
+  void compile(const Filter* filter);
+  void compile(const std::vector<const Filter*> &operands, OpCode op);
+  unsigned int add(OpCode op, unsigned int var = 0, double val1 = 0., double val2 = 0.);
+  void setJumpTarget(unsigned int instr) { code_.at(instr).target_ = code_.size(); }
+
+
+private:
+  class Instruction {
+  public:
+    Instruction(OpCode op, unsigned int var, double val1, double val2)
+      : op_(op), var_(var), val1_(val1), val2_(val2), target_(0) {};
+
+    OpCode op_;
+    unsigned int var_;			// Or memo slot, or sample
+    double val1_;
+    double val2_;
+    unsigned int target_;		// For jumps
+  };
+
+  static bool isSampling_;
+  static std::map<const Filter*,Statistics> statistics_;
+
+  const Filter* filter_;
+  const Slots* slots_;
+  std::vector<Instruction> code_;
+  unsigned int depth_;
+  unsigned int maxDepth_;
+  std::vector<Statistics*> samples_;	// Of the sample instructions
+  std::vector<TString> reorderings_;
+
+  void push(const Instruction &instr, int nPushed);
+  void order(std::vector<const Filter*> &operands, OpCode op);
+};
+#endif
@@ -2,7 +2,11 @@
 #include <iostream>
 #include <sys/stat.h>
 
+#include "RVersion.h"
+#include "TROOT.h"
+
 #include "GlobalParameters.h"
+#include "Profiler.h"
 
 
 // CVS Information; will be substituted by cvs
@@ -17,9 +21,22 @@ TString GlobalParameters::inputPath_ = "";
 bool GlobalParameters::outputEPS_ = false;
 bool GlobalParameters::outputPNG_ = false;
 bool GlobalParameters::outputPDF_ = false;
+unsigned int GlobalParameters::nThreads_ = 1;
+TString GlobalParameters::cacheDir_ = "";
+unsigned int GlobalParameters::nRenderProcesses_ = 1;
+unsigned int GlobalParameters::chunkSize_ = 0;
+bool GlobalParameters::kahanSummation_ = false;
+bool GlobalParameters::profile_ = false;
+bool GlobalParameters::bulkRead_ = false;
+unsigned int GlobalParameters::treeCacheSize_ = 0;
+bool GlobalParameters::prefetch_ = false;
+unsigned int GlobalParameters::nImplicitMTThreads_ = 0;
+bool GlobalParameters::incremental_ = false;
+bool GlobalParameters::adaptiveCutOrder_ = false;
 
 
 void GlobalParameters::init(const Config &cfg, const TString &key) {
+  Profiler::Timer timer("GlobalParameters::init");
   std::cout << "  Setting global parameters...  " << std::flush;
   std::vector<Config::Attributes> attrList = cfg(key);
   for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
@@ -48,6 +65,61 @@ void GlobalParameters::init(const Config &cfg, const TString &key) {
 	}
       }
     }
+    if( it->hasName("threads") ) {
+      TString threads = it->value("threads");
+      if( threads.IsDigit() && threads.Atoi() > 0 ) {
+	nThreads_ = threads.Atoi();
+      } else {
+	std::cerr << "    \nWARNING: invalid number of threads '" << threads << "' defined in line " << it->lineNumber() << std::endl;
+	std::cerr << "    Using 1 thread" << std::endl;
+      }
+    }
+    if( it->hasName("render processes") ) {
+      TString processes = it->value("render processes");
+      if( processes.IsDigit() && processes.Atoi() > 0 ) {
+	nRenderProcesses_ = processes.Atoi();
+      } else {
+	std::cerr << "    \nWARNING: invalid number of render processes '" << processes << "' defined in line " << it->lineNumber() << std::endl;
+	std::cerr << "    Using 1 process" << std::endl;
+      }
+    }
+    if( it->hasName("chunk size") ) {
+      TString size = it->value("chunk size");
+      if( size.IsDigit() ) {
+	chunkSize_ = size.Atoi();
+      } else {
+	std::cerr << "    \nWARNING: invalid chunk size '" << size << "' defined in line " << it->lineNumber() << std::endl;
+	std::cerr << "    Keeping all events in memory" << std::endl;
+      }
+    }
+    if( it->hasName("kahan summation") ) kahanSummation_ = it->isBoolean("kahan summation") && it->valueBoolean("kahan summation");
+    if( it->hasName("profile") ) profile_ = it->isBoolean("profile") && it->valueBoolean("profile");
+    if( it->hasName("bulk read") ) bulkRead_ = it->isBoolean("bulk read") && it->valueBoolean("bulk read");
+    if( it->hasName("tree cache size") ) {
+      TString size = it->value("tree cache size");
+      if( size.IsDigit() ) {
+	treeCacheSize_ = size.Atoi();
+      } else {
+	std::cerr << "    \nWARNING: invalid tree cache size '" << size << "' defined in line " << it->lineNumber() << std::endl;
+	std::cerr << "    Using the ROOT default" << std::endl;
+      }
+    }
+    if( it->hasName("prefetch") ) prefetch_ = it->isBoolean("prefetch") && it->valueBoolean("prefetch");
+    if( it->hasName("implicit mt threads") ) {
+      TString threads = it->value("implicit mt threads");
+      if( threads.IsDigit() ) {
+	nImplicitMTThreads_ = threads.Atoi();
+      } else {
+	std::cerr << "    \nWARNING: invalid number of implicit mt threads '" << threads << "' defined in line " << it->lineNumber() << std::endl;
+	std::cerr << "    Disabling implicit multithreading" << std::endl;
+      }
+    }
+    if( it->hasName("incremental") ) incremental_ = it->isBoolean("incremental") && it->valueBoolean("incremental");
+    if( it->hasName("adaptive cut order") ) adaptiveCutOrder_ = it->isBoolean("adaptive cut order") && it->valueBoolean("adaptive cut order");
+    if( it->hasName("cache") ) {
+      cacheDir_ = it->value("cache");
+      while( cacheDir_.EndsWith("/") ) cacheDir_.Chop();
+    }
     if( it->hasName("publication status") ) {
       TString status = it->value("publication status");
       status.ToLower();
@@ -64,12 +136,27 @@ void GlobalParameters::init(const Config &cfg, const TString &key) {
 
   // Check values
   if( !outputEPS() && !outputPNG() && !outputPDF() ) outputPDF_ = true;	// Make pdf default output format
+  // In incremental mode, the events are always cached
+  if( incremental() && cacheDir() == "" ) cacheDir_ = "results/"+analysisId()+"/cache";
+  // A process with ROOT's thread pool cannot be forked safely
+  if( nRenderProcesses() > 1 && nImplicitMTThreads() > 0 ) {
+    std::cerr << "    \nWARNING: render processes cannot be combined with implicit mt threads" << std::endl;
+    std::cerr << "    Using 1 render process" << std::endl;
+    nRenderProcesses_ = 1;
+  }
 
   std::cout << "ok" << std::endl;
 
   std::cout << "  Preparing the environment...  " << std::flush;
   mkdir("results",S_IRWXU);
   mkdir(("results/"+analysisId()).Data(),S_IRWXU);
+  if( cacheDir() != "" ) mkdir(cacheDir().Data(),S_IRWXU);
+  // The render processes are forked without a graphics system
+  if( nRenderProcesses() > 1 ) gROOT->SetBatch(kTRUE);
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,8,0)
+  // ROOT decompresses the branches of each entry in parallel
+  if( nImplicitMTThreads() > 0 ) ROOT::EnableImplicitMT(nImplicitMTThreads());
+#endif
 
   std::cout << "ok" << std::endl;
 }
@@ -21,6 +21,18 @@ public:
   static bool outputEPS() { return outputEPS_; }
   static bool outputPNG() { return outputPNG_; }
   static bool outputPDF() { return outputPDF_; }
+  static unsigned int nThreads() { return nThreads_; }
+  static TString cacheDir() { return cacheDir_; }
+  static unsigned int nRenderProcesses() { return nRenderProcesses_; }
+  static unsigned int chunkSize() { return chunkSize_; } // 0: all events in memory
+  static bool kahanSummation() { return kahanSummation_; }
+  static bool profile() { return profile_; }
+  static bool bulkRead() { return bulkRead_; }
+  static unsigned int treeCacheSize() { return treeCacheSize_; } // In MB; 0: ROOT default
+  static bool prefetch() { return prefetch_; }
+  static unsigned int nImplicitMTThreads() { return nImplicitMTThreads_; } // 0: disabled
+  static bool incremental() { return incremental_; }
+  static bool adaptiveCutOrder() { return adaptiveCutOrder_; }
 
   static TString cvsRevision();
   static TString cvsTag();
@@ -36,5 +48,17 @@ private:
   static bool outputEPS_;
   static bool outputPNG_;
   static bool outputPDF_;
+  static unsigned int nThreads_;
+  static TString cacheDir_;
+  static unsigned int nRenderProcesses_;
+  static unsigned int chunkSize_;
+  static bool kahanSummation_;
+  static bool profile_;
+  static bool bulkRead_;
+  static unsigned int treeCacheSize_;
+  static bool prefetch_;
+  static unsigned int nImplicitMTThreads_;
+  static bool incremental_;
+  static bool adaptiveCutOrder_;
 };
 #endif
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TStopwatch.h"
+
+#include "GlobalParameters.h"
+#include "HistFiller.h"
+#include "Profiler.h"
+#include "Variable.h"
+
+
+unsigned int HistFiller::count_ = 0;
+
+
+HistFiller::~HistFiller() {
+  for(std::map<Key,Hists>::iterator it = hists_.begin();
+      it != hists_.end(); ++it) {
+    delete it->second.h_;
+    if( it->second.hDn_ ) delete it->second.hDn_;
+    if( it->second.hUp_ ) delete it->second.hUp_;
+  }
+}
+
+
+void HistFiller::book1D(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax, const TString &profileName) {
+  Key key(dataSet,var,nBinsX,xMin,xMax);
+  if( hists_.find(key) == hists_.end() ) {
+    ++HistFiller::count_;
+    TString name = "HistFiller";
+    name += count_;
+    Hists &hists = hists_[key];
+    hists.h_ = new TH1D(name,"",nBinsX,xMin,xMax);
+    hists.h_->SetDirectory(0);
+    hists.h_->Sumw2();
+    hists.hDn_ = static_cast<TH1*>(hists.h_->Clone(name+"Dn"));
+    hists.hDn_->SetDirectory(0);
+    hists.hUp_ = static_cast<TH1*>(hists.h_->Clone(name+"Up"));
+    hists.hUp_->SetDirectory(0);
+    isFilled_ = false;
+  }
+  addProfileName(hists_[key],profileName);
+}
+
+
+void HistFiller::book2D(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax, const TString &profileName) {
+  Key key(dataSet,var1,var2,nBinsX,xMin,xMax,nBinsY,yMin,yMax);
+  if( hists_.find(key) == hists_.end() ) {
+    ++HistFiller::count_;
+    TString name = "HistFiller";
+    name += count_;
+    Hists &hists = hists_[key];
+    hists.h_ = new TH2D(name,"",nBinsX,xMin,xMax,nBinsY,yMin,yMax);
+    hists.h_->SetDirectory(0);
+    hists.h_->Sumw2();
+    isFilled_ = false;
+  }
+  addProfileName(hists_[key],profileName);
+}
+
+
+void HistFiller::addProfileName(Hists &hists, const TString &profileName) const {
+  if( profileName == "" ) return;
+  if( std::find(hists.profileNames_.begin(),hists.profileNames_.end(),profileName) == hists.profileNames_.end() ) {
+    hists.profileNames_.push_back(profileName);
+  }
+}
+
+
+// Fill all booked histograms. The bookings are sorted by
+// dataset, hence the events of each dataset are read once.
+void HistFiller::fill() {
+  if( GlobalParameters::debug() ) {
+    std::cout << "DEBUG: Entering HistFiller::fill()" << std::endl;
+  }
+
+  std::map<Key,Hists>::const_iterator it = hists_.begin();
+  while( it != hists_.end() ) {
+    const DataSet* dataSet = it->first.dataSet_;
+    std::vector< std::pair<Key,Hists> > hists;
+    for(; it != hists_.end() && it->first.dataSet_ == dataSet; ++it) {
+      // Empty the histograms in case they were filled before
+      it->second.h_->Reset();
+      if( it->second.hDn_ ) it->second.hDn_->Reset();
+      if( it->second.hUp_ ) it->second.hUp_->Reset();
+      hists.push_back(*it);
+    }
+    if( GlobalParameters::debug() ) {
+      std::cout << "       Filling " << hists.size() << " histograms for '" << dataSet->uid() << "'" << std::endl;
+    }
+    fill(dataSet,hists);
+  }
+  isFilled_ = true;
+
+  if( GlobalParameters::debug() ) {
+    std::cout << "DEBUG: Leaving HistFiller::fill()" << std::endl;
+  }
+}
+
+
+// Add the current events of 'dataSet' to its booked histograms
+// without resetting them
+void HistFiller::fill(const DataSet* dataSet) {
+  std::vector< std::pair<Key,Hists> > hists;
+  for(std::map<Key,Hists>::const_iterator it = hists_.begin();
+      it != hists_.end(); ++it) {
+    if( it->first.dataSet_ == dataSet ) hists.push_back(*it);
+  }
+  if( hists.size() > 0 ) fill(dataSet,hists);
+  isFilled_ = true;
+}
+
+
+// One pass over the events. If profiling, the time of the pass is
+// split among the histograms in proportion to their number of
+// Fill() calls and added to the Profiler entries of their bookings.
+void HistFiller::fill(const DataSet* dataSet, const std::vector< std::pair<Key,Hists> > &hists) const {
+  TStopwatch watch;
+  if( GlobalParameters::profile() ) watch.Start();
+
+  // Split into 1D and 2D histograms
+  std::vector<unsigned int> vars1D;
+  std::vector<TH1*> h1D;
+  std::vector<TH1*> h1DDn;
+  std::vector<TH1*> h1DUp;
+  std::vector<unsigned int> vars2DX;
+  std::vector<unsigned int> vars2DY;
+  std::vector<TH2*> h2D;
+  for(std::vector< std::pair<Key,Hists> >::const_iterator it = hists.begin();
+      it != hists.end(); ++it) {
+    if( it->first.var2_ < 0 ) {
+      vars1D.push_back(it->first.var1_);
+      h1D.push_back(it->second.h_);
+      h1DDn.push_back(it->second.hDn_);
+      h1DUp.push_back(it->second.hUp_);
+    } else {
+      vars2DX.push_back(it->first.var1_);
+      vars2DY.push_back(it->first.var2_);
+      h2D.push_back(static_cast<TH2*>(it->second.h_));
+    }
+  }
+
+  // One pass over the events
+  unsigned int nEvts = 0;
+  unsigned int nEvtsUnc = 0;
+  for(EventIt itd = dataSet->evtsBegin(); itd != dataSet->evtsEnd(); ++itd) {
+    const double w = itd->weight();
+    const bool hasUnc = itd->hasUnc();
+    ++nEvts;
+    if( hasUnc ) ++nEvtsUnc;
+    for(unsigned int i = 0; i < h1D.size(); ++i) {
+      double v = itd->get(vars1D[i]);
+      h1D[i]->Fill(v,w);
+      if( hasUnc ) {
+	h1DDn[i]->Fill(v,itd->weightUncDn());
+	h1DUp[i]->Fill(v,itd->weightUncUp());
+      }
+    }
+    for(unsigned int i = 0; i < h2D.size(); ++i) {
+      h2D[i]->Fill(itd->get(vars2DX[i]),itd->get(vars2DY[i]),w);
+    }
+  }
+  if( !GlobalParameters::profile() ) return;
+  watch.Stop();
+
+  // A 1D histogram is filled also with the varied weights
+  const double nFills1D = nEvts + 2.*nEvtsUnc;
+  const double nFills2D = nEvts;
+  const double nFills = h1D.size()*nFills1D + h2D.size()*nFills2D;
+  if( nFills == 0. ) return;
+  for(std::vector< std::pair<Key,Hists> >::const_iterator it = hists.begin();
+      it != hists.end(); ++it) {
+    const double share = ( it->first.var2_ < 0 ? nFills1D : nFills2D ) / nFills;
+    for(std::vector<TString>::const_iterator itn = it->second.profileNames_.begin();
+	itn != it->second.profileNames_.end(); ++itn) {
+      Profiler::add(*itn,share*watch.RealTime(),share*watch.CpuTime());
+    }
+  }
+}
+
+
+const TH2* HistFiller::hist2D(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax) const {
+  return static_cast<const TH2*>(find(Key(dataSet,var1,var2,nBinsX,xMin,xMax,nBinsY,yMin,yMax)).h_);
+}
+
+
+const HistFiller::Hists& HistFiller::find(const Key &key) const {
+  std::map<Key,Hists>::const_iterator it = hists_.find(key);
+  if( it == hists_.end() || !isFilled_ ) {
+    std::cerr << "\n\nERROR in HistFiller::find(): histogram for dataset '" << key.dataSet_->uid() << "' has not been " << (it == hists_.end() ? "booked" : "filled") << std::endl;
+    exit(-1);
+  }
+
+  return it->second;
+}
+
+
+
+// ---------------------------------------------------------------
+HistFiller::Key::Key(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax)
+  : dataSet_(dataSet), var1_(Variable::index(var)), var2_(-1),
+    nBinsX_(nBinsX), xMin_(xMin), xMax_(xMax), nBinsY_(0), yMin_(0.), yMax_(0.) {}
+
+
+HistFiller::Key::Key(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax)
+  : dataSet_(dataSet), var1_(Variable::index(var1)), var2_(Variable::index(var2)),
+    nBinsX_(nBinsX), xMin_(xMin), xMax_(xMax), nBinsY_(nBinsY), yMin_(yMin), yMax_(yMax) {}
+
+
+bool HistFiller::Key::operator<(const Key &other) const {
+  if( dataSet_ != other.dataSet_ ) return dataSet_ < other.dataSet_;
+  if( var1_ != other.var1_ ) return var1_ < other.var1_;
+  if( var2_ != other.var2_ ) return var2_ < other.var2_;
+  if( nBinsX_ != other.nBinsX_ ) return nBinsX_ < other.nBinsX_;
+  if( xMin_ != other.xMin_ ) return xMin_ < other.xMin_;
+  if( xMax_ != other.xMax_ ) return xMax_ < other.xMax_;
+  if( nBinsY_ != other.nBinsY_ ) return nBinsY_ < other.nBinsY_;
+  if( yMin_ != other.yMin_ ) return yMin_ < other.yMin_;
+  return yMax_ < other.yMax_;
+}
@@ -0,0 +1,78 @@
+#ifndef HIST_FILLER_H
+#define HIST_FILLER_H
+
+#include <map>
+#include <vector>
+
+#include "TH1.h"
+#include "TH2.h"
+#include "TString.h"
+
+#include "DataSet.h"
+
+
+// Fills all histograms of a dataset in one pass over its events.
+// Histograms are first booked via book1D() and book2D(), then all
+// of them are filled by fill(), and afterwards they can be accessed
+// for drawing. Identical bookings are filled only once.
+// In streaming mode, fill(dataSet) is called instead for each chunk
+// of events, and the histograms are accumulated.
+class HistFiller {
+public:
+  HistFiller() : isFilled_(false) {};
+  ~HistFiller();
+
+  // If profiling, the share of the filling time of the histogram is
+  // added to the Profiler entries 'profileName' of all its bookings
+  void book1D(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax, const TString &profileName = "");
+  void book2D(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax, const TString &profileName = "");
+  void fill();
+  void fill(const DataSet* dataSet);
+
+  // The 1D distribution and the distributions with the
+  // weights varied down and up by the total uncertainty
+  const TH1* hist1D(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax) const { return find(Key(dataSet,var,nBinsX,xMin,xMax)).h_; }
+  const TH1* hist1DDn(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax) const { return find(Key(dataSet,var,nBinsX,xMin,xMax)).hDn_; }
+  const TH1* hist1DUp(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax) const { return find(Key(dataSet,var,nBinsX,xMin,xMax)).hUp_; }
+  const TH2* hist2D(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax) const;
+
+
+private:
+  class Key {
+  public:
+    Key(const DataSet* dataSet, const TString &var, int nBinsX, double xMin, double xMax);
+    Key(const DataSet* dataSet, const TString &var1, const TString &var2, int nBinsX, double xMin, double xMax, int nBinsY, double yMin, double yMax);
+
+    bool operator<(const Key &other) const;
+
+    const DataSet* dataSet_;
+    int var1_;
+    int var2_;		// -1 for 1D histograms
+    int nBinsX_;
+    double xMin_;
+    double xMax_;
+    int nBinsY_;
+    double yMin_;
+    double yMax_;
+  };
+
+  class Hists {
+  public:
+    Hists() : h_(0), hDn_(0), hUp_(0) {};
+
+    TH1* h_;
+    TH1* hDn_;
+    TH1* hUp_;
+    std::vector<TString> profileNames_;
+  };
+
+  static unsigned int count_;
+
+  bool isFilled_;
+  std::map<Key,Hists> hists_;
+
+  const Hists& find(const Key &key) const;
+  void addProfileName(Hists &hists, const TString &profileName) const;
+  void fill(const DataSet* dataSet, const std::vector< std::pair<Key,Hists> > &hists) const;
+};
+#endif
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+
+#include "GlobalParameters.h"
+#include "Manifest.h"
+#include "Output.h"
+#include "Profiler.h"
+
+
+bool Manifest::isEnabled_ = false;
+TString Manifest::inputHash_ = "";
+TString Manifest::runKey_ = "run";
+std::map<TString,Manifest::Entry> Manifest::previous_;
+std::map<TString,Manifest::Entry> Manifest::current_;
+
+
+// The inputs common to all outputs are the program version, the
+// config lines of the keys 'global', 'style', 'variable', 'selection',
+// and 'dataset', and the input files of the datasets. Global
+// parameters that only affect the performance are ignored. The
+// version is the tag of a released version and, for a developer's
+// version, the executable itself. If an input cannot be accessed,
+// all outputs are outdated.
+// ---------------------------------------------------------------
+void Manifest::init(const Config &cfg) {
+  Profiler::Timer timer("Manifest::init");
+  isEnabled_ = GlobalParameters::incremental();
+  if( !isEnabled_ ) return;
+
+  std::cout << "  Checking for up-to-date outputs...  " << std::flush;
+  std::set<TString> performanceNames;
+  performanceNames.insert("debug");
+  performanceNames.insert("threads");
+  performanceNames.insert("render processes");
+  performanceNames.insert("cache");
+  performanceNames.insert("chunk size");
+  performanceNames.insert("profile");
+  performanceNames.insert("bulk read");
+  performanceNames.insert("tree cache size");
+  performanceNames.insert("prefetch");
+  performanceNames.insert("implicit mt threads");
+  performanceNames.insert("incremental");
+  performanceNames.insert("adaptive cut order");
+
+  TString fp = "";
+  bool hasAllInputs = fingerprint("/proc/self/exe",fp);
+  TString inputs = "version: "+GlobalParameters::cvsTag()+" "+fp;
+  std::vector<Config::Attributes> attrList = cfg("global");
+  for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
+      it != attrList.end(); ++it) {
+    std::vector<TString> names = it->listOfNames();
+    std::sort(names.begin(),names.end());
+    for(std::vector<TString>::const_iterator itn = names.begin();
+	itn != names.end(); ++itn) {
+      if( performanceNames.count(*itn) == 0 ) inputs += "\nglobal :: "+(*itn)+": "+it->value(*itn);
+    }
+  }
+  inputs += "\n"+key(cfg,"style");
+  inputs += "\n"+key(cfg,"variable");
+  inputs += "\n"+key(cfg,"selection");
+  inputs += "\n"+key(cfg,"dataset");
+
+  // Input files, with the global path prepended as in DataSet::init()
+  attrList = cfg("dataset");
+  for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
+      it != attrList.end(); ++it) {
+    if( !it->hasName("files") ) continue;
+    std::vector<TString> files;
+    Config::split(it->value("files"),",",files);
+    for(std::vector<TString>::const_iterator itf = files.begin();
+	itf != files.end(); ++itf) {
+      TString file = *itf;
+      if( !( file(0) == '/' || file(0) == '~') ) file = GlobalParameters::inputPath()+file;
+      if( fingerprint(file,fp) ) inputs += "\nfile: "+fp;
+      else hasAllInputs = false;
+    }
+  }
+  inputHash_ = Config::hash(inputs);
+
+  // The run as a whole is up to date if all plots and
+  // the event information are
+  runKey_ = "run | "+key(cfg,"plot")+" | "+key(cfg,"print event info");
+
+  previous_.clear();
+  if( hasAllInputs ) read();
+  std::cout << "ok" << std::endl;
+}
+
+
+// ---------------------------------------------------------------
+TString Manifest::fileName() {
+  return Output::resultDir()+"/"+Output::id()+"_Manifest.txt";
+}
+
+
+// The names are sorted such that the key does not depend
+// on their order in the config line
+// ---------------------------------------------------------------
+TString Manifest::key(const TString &key, const Config::Attributes &attr) {
+  std::vector<TString> names = attr.listOfNames();
+  std::sort(names.begin(),names.end());
+  TString result = key+" ::";
+  for(std::vector<TString>::const_iterator it = names.begin();
+      it != names.end(); ++it) {
+    result += " "+(*it)+": "+attr.value(*it)+";";
+  }
+
+  return result;
+}
+
+
+// ---------------------------------------------------------------
+TString Manifest::key(const Config &cfg, const TString &key) {
+  TString result = "";
+  std::vector<Config::Attributes> attrList = cfg(key);
+  for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
+      it != attrList.end(); ++it) {
+    if( it != attrList.begin() ) result += " | ";
+    result += Manifest::key(key,*it);
+  }
+
+  return result;
+}
+
+
+// An up-to-date output is kept in the manifest of this run
+// ---------------------------------------------------------------
+bool Manifest::isUpToDate(const TString &output) {
+  if( !isEnabled_ ) return false;
+
+  std::map<TString,Entry>::const_iterator it = previous_.find(output);
+  if( it == previous_.end() || it->second.hash_ != outputHash(output) ) return false;
+  for(std::vector<TString>::const_iterator itf = it->second.files_.begin();
+      itf != it->second.files_.end(); ++itf) {
+    struct stat st;
+    if( stat(itf->Data(),&st) != 0 ) return false;
+  }
+  current_[output] = it->second;
+
+  return true;
+}
+
+
+// ---------------------------------------------------------------
+void Manifest::update(const TString &output, const std::vector<TString> &files) {
+  if( !isEnabled_ ) return;
+
+  Entry &entry = current_[output];
+  entry.hash_ = outputHash(output);
+  entry.files_ = files;
+}
+
+
+// Writes the outputs of this run. Outputs of the previous run
+// that are not defined anymore are dropped; their files are kept.
+// ---------------------------------------------------------------
+void Manifest::write() {
+  if( !isEnabled_ ) return;
+
+  std::ofstream file(fileName().Data());
+  if( !file.is_open() ) {
+    std::cerr << "\nWARNING in Manifest: cannot write file '" << fileName() << "'" << std::endl;
+    return;
+  }
+
+  // The run depends on the files of all outputs
+  Entry run;
+  run.hash_ = outputHash(runKey_);
+  for(std::map<TString,Entry>::const_iterator it = current_.begin();
+      it != current_.end(); ++it) {
+    if( it->first == runKey_ ) continue;
+    run.files_.insert(run.files_.end(),it->second.files_.begin(),it->second.files_.end());
+  }
+  current_[runKey_] = run;
+
+  file << "# MrRA2 manifest: hashes of the inputs and files of each output\n";
+  for(std::map<TString,Entry>::const_iterator it = current_.begin();
+      it != current_.end(); ++it) {
+    file << "output: " << it->first << "\n";
+    file << "hash: " << it->second.hash_ << "\n";
+    for(std::vector<TString>::const_iterator itf = it->second.files_.begin();
+	itf != it->second.files_.end(); ++itf) {
+      file << "file: " << *itf << "\n";
+    }
+  }
+}
+
+
+// Modification time and size of the file
+// ---------------------------------------------------------------
+bool Manifest::fingerprint(const TString &fileName, TString &result) {
+  struct stat st;
+  if( stat(fileName.Data(),&st) != 0 ) return false;
+  result = TString::Format("%s %ld %lld",fileName.Data(),static_cast<long>(st.st_mtime),static_cast<long long>(st.st_size));
+
+  return true;
+}
+
+
+// Reads the manifest of the previous run, if it exists
+// ---------------------------------------------------------------
+void Manifest::read() {
+  std::ifstream file(fileName().Data());
+  if( !file.is_open() ) return;
+
+  Entry* entry = 0;
+  std::string line;
+  while( std::getline(file,line) ) {
+    TString str = line.c_str();
+    if( str.BeginsWith("output: ") ) {
+      entry = &previous_[str(8,str.Length()-8)];
+    } else if( entry != 0 && str.BeginsWith("hash: ") ) {
+      entry->hash_ = str(6,str.Length()-6);
+    } else if( entry != 0 && str.BeginsWith("file: ") ) {
+      entry->files_.push_back(str(6,str.Length()-6));
+    }
+  }
+}
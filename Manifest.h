@@ -0,0 +1,56 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <map>
+#include <vector>
+
+#include "TString.h"
+
+#include "Config.h"
+
+
+// Dependency tracking for the incremental mode ('global :: incremental:
+// true'). Each output (a plot defined in one config line, the event
+// yields, the event information) is identified by a key and has a hash
+// of its inputs: its own config lines, the config lines all outputs
+// depend on, the fingerprints (modification time and size) of the input
+// files, and the version of the program. The hashes and the files of the
+// outputs are stored in 'results/<id>/<id>_Manifest.txt'. An output whose
+// hash did not change since the previous run and whose files still exist
+// is up to date and need not be created again.
+class Manifest {
+public:
+  static void init(const Config &cfg);
+  static bool isEnabled() { return isEnabled_; }
+  static TString fileName();
+
+  // Key of the output defined by one config line or by all lines of 'key'
+  static TString key(const TString &key, const Config::Attributes &attr);
+  static TString key(const Config &cfg, const TString &key);
+
+  // Whether all outputs of this run are up to date
+  static bool isUpToDate() { return isUpToDate(runKey_); }
+  static bool isUpToDate(const TString &output);
+  // Records that 'output' has been created with the given files
+  static void update(const TString &output, const std::vector<TString> &files);
+  static void write();
+
+
+private:
+  class Entry {
+  public:
+    TString hash_;
+    std::vector<TString> files_;
+  };
+
+  static bool isEnabled_;
+  static TString inputHash_;	// Hash of the inputs common to all outputs
+  static TString runKey_;	// Key of the run, i.e. of all outputs together
+  static std::map<TString,Entry> previous_;
+  static std::map<TString,Entry> current_;
+
+  static TString outputHash(const TString &output) { return Config::hash(inputHash_+"\n"+output); }
+  static bool fingerprint(const TString &fileName, TString &result);
+  static void read();
+};
+#endif
@@ -7,10 +7,12 @@
 #include "DataSet.h"
 #include "EventInfoPrinter.h"
 #include "GlobalParameters.h"
+#include "Manifest.h"
 #include "MrRA2.h"
 #include "EventYieldPrinter.h"
 #include "Output.h"
 #include "PlotBuilder.h"
+#include "Profiler.h"
 #include "Selection.h"
 #include "Style.h"
 #include "Variable.h"
@@ -31,6 +33,7 @@ int main(int argc, char *argv[]) {
 
 
 MrRA2::MrRA2(const TString& configFileName) {
+  Profiler::Timer timer("MrRA2");
   std::cout << "\n +------------------------------------------------+" << std::endl;
   std::cout << " |                                                |" << std::endl;
   std::cout << " |     MrRA2 - the Really Awesome plotting 2l     |" << std::endl;
@@ -51,7 +54,29 @@ MrRA2::MrRA2(const TString& configFileName) {
   Style::init(cfg,"style");
   Variable::init(cfg,"variable");
   Selection::init(cfg,"selection");
+  Manifest::init(cfg);
+  if( Manifest::isUpToDate() ) {
+    std::cout << "\n\n\nAll outputs are up to date, see '" << Manifest::fileName() << "'" << std::endl;
+    std::cout << "Done.\nThank you for using MrRA2! Want to donate money? Contact M. Schroeder." << std::endl;
+    return;
+  }
+  PlotBuilder::useVariables(cfg);
+  EventInfoPrinter::useVariables(cfg);
   DataSet::init(cfg,"dataset");
+
+  // Control the output
+  Output out;
+
+  // Book the output. In streaming mode, it is accumulated
+  // while the events are read.
+  PlotBuilder plotBuilder(cfg,out);
+  EventInfoPrinter evtInfoPrinter(cfg);
+  if( GlobalParameters::chunkSize() > 0 ) {
+    std::vector<EventConsumer*> consumers;
+    consumers.push_back(&plotBuilder);
+    consumers.push_back(&evtInfoPrinter);
+    DataSet::stream(consumers);
+  }
   std::cout << "\n\n\n";
   
 
@@ -67,6 +92,7 @@ MrRA2::MrRA2(const TString& configFileName) {
     if( (*its)->uid() != "unselected" ) (*its)->print();
   }
   std::cout << "\n";
+  Selection::printCutOrder();
 
 
   // Print simple cut flow
@@ -79,14 +105,22 @@ MrRA2::MrRA2(const TString& configFileName) {
     }
   }
 
-  // Control the output
-  Output out;
-
   // Control plots without selection
   std::cout << "\n\n\nProcessing the output" << std::endl;
-  PlotBuilder(cfg,out);
-  EventInfoPrinter evtInfoPrinter(cfg);
+  plotBuilder.run();
+  evtInfoPrinter.run();
   EventYieldPrinter evtYieldPrinter;
+  out.waitForRendering();
+  if( Manifest::isEnabled() ) {
+    std::cout << "  - Writing the manifest of the outputs to '" << Manifest::fileName() << "'" << std::endl;
+    Manifest::write();
+  }
+  timer.stop();
+  if( GlobalParameters::profile() ) {
+    const TString profileName = Output::resultDir()+"/"+Output::id()+"_Profile.json";
+    std::cout << "  - Writing timing information to '" << profileName << "'" << std::endl;
+    Profiler::write(profileName);
+  }
 
   std::cout << "Done.\nThank you for using MrRA2! Want to donate money? Contact M. Schroeder." << std::endl;
 }
@@ -1,8 +1,12 @@
 #include <iostream>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include "TROOT.h"
 
 #include "Output.h"
+#include "Profiler.h"
 
 
 Output::Output() {
@@ -102,12 +106,84 @@ void Output::addPlot(TCanvas* can, const TString &var, const std::vector<TString
 }
 
 
+// With more than one render process, the canvas is exported by a
+// forked child process, which works on its own copy of the canvas
+// and of ROOT's global state. At most 'render processes' children
+// run at the same time; the caller may delete the canvas right away.
+// Only processes in batch mode and without ROOT's thread pool are
+// forked (see GlobalParameters::init()); otherwise, the canvas is
+// exported by this process.
 void Output::storeCanvas(TCanvas* can, const TString &selection, const TString &plotName) {
+  Profiler::Timer timer("Output::storeCanvas");
   can->SetName(plotName);
   can->SetTitle(plotName);
-  if( GlobalParameters::outputEPS() ) can->SaveAs(resultDir()+"/"+dir(selection)+"/"+plotName+".eps","eps");
-  if( GlobalParameters::outputPDF() ) can->SaveAs(resultDir()+"/"+dir(selection)+"/"+plotName+".pdf");
-  if( GlobalParameters::outputPNG() ) can->SaveAs(resultDir()+"/"+dir(selection)+"/"+plotName+".png");
+  const TString fileName = resultDir()+"/"+dir(selection)+"/"+plotName;
+  if( GlobalParameters::outputEPS() ) files_.push_back(fileName+".eps");
+  if( GlobalParameters::outputPDF() ) files_.push_back(fileName+".pdf");
+  if( GlobalParameters::outputPNG() ) files_.push_back(fileName+".png");
+  if( GlobalParameters::nRenderProcesses() > 1 && gROOT->IsBatch() ) {
+    while( renderProcesses_.size() >= GlobalParameters::nRenderProcesses() ) {
+      waitForRenderProcess();
+    }
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    pid_t pid = fork();
+    if( pid == 0 ) {
+      _exit( saveAs(can,fileName) ? 0 : 1 );
+    } else if( pid > 0 ) {
+      renderProcesses_[pid] = plotName;
+      return;
+    }
+    std::cerr << "\nWARNING: cannot start render process for plot '" << plotName << "'" << std::endl;
+  }
+  if( !saveAs(can,fileName) ) {
+    std::cerr << "\nWARNING: storing plot '" << plotName << "' failed" << std::endl;
+  }
+}
+
+
+// Returns false if one of the files has not been written. Files of
+// a previous run are removed first, such that they are not mistaken
+// for the new ones.
+bool Output::saveAs(TCanvas* can, const TString &fileName) const {
+  std::vector<TString> names;
+  if( GlobalParameters::outputEPS() ) names.push_back(fileName+".eps");
+  if( GlobalParameters::outputPDF() ) names.push_back(fileName+".pdf");
+  if( GlobalParameters::outputPNG() ) names.push_back(fileName+".png");
+  bool isStored = true;
+  for(std::vector<TString>::const_iterator it = names.begin();
+      it != names.end(); ++it) {
+    unlink(it->Data());
+    if( it->EndsWith(".eps") ) can->SaveAs(*it,"eps");
+    else can->SaveAs(*it);
+    struct stat st;
+    if( stat(it->Data(),&st) != 0 ) isStored = false;
+  }
+
+  return isStored;
+}
+
+
+void Output::waitForRendering() {
+  Profiler::Timer timer("Output::waitForRendering");
+  while( renderProcesses_.size() > 0 ) waitForRenderProcess();
+}
+
+
+void Output::waitForRenderProcess() {
+  int status = 0;
+  pid_t pid = waitpid(-1,&status,0);
+  if( pid < 0 ) {		// No children left
+    renderProcesses_.clear();
+    return;
+  }
+  std::map< int, TString >::iterator it = renderProcesses_.find(pid);
+  if( it != renderProcesses_.end() ) {
+    if( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+      std::cerr << "\nWARNING: storing plot '" << it->second << "' failed" << std::endl;
+    }
+    renderProcesses_.erase(it);
+  }
 }
  
 
@@ -22,13 +22,19 @@ public:
   static TString cleanLatexName(const TString &name);
 
   Output();
-  ~Output() {};
+  ~Output() { waitForRendering(); }
 
   void addPlot(TCanvas* can, const TString &var, const TString &dataSetLabel, const TString &selection);
   void addPlot(TCanvas* can, const TString &var, const std::vector<TString> &dataSetLabels, const TString &plotType, const TString &selection);
   void addPlot(TCanvas* can, const TString &var, const std::vector<TString> &dataSetLabels1, const std::vector<TString> &dataSetLabels2, const TString &selection);
 
   void createLaTeXSlide() const;
+  // Names of the files stored in this run, in the order of storing.
+  // Up-to-date plots of the incremental mode are not stored again,
+  // see Manifest.
+  const std::vector<TString>& files() const { return files_; }
+  // Blocks until all plots are stored
+  void waitForRendering();
 
 
 private:
@@ -36,8 +42,12 @@ private:
   std::map< TString, std::map< TString, std::vector<TString> > > plotsSingleSpectrum_;
   std::map< TString, std::vector<TString> > plotsNormedSpectra_;
   std::map< TString, std::map< TString, std::vector<TString> > > plotsStack_;
+  std::map< int, TString > renderProcesses_;	// pid and plot name
+  std::vector<TString> files_;
 
   TString dir(const TString &selection);
   void storeCanvas(TCanvas* can, const TString &selection, const TString &plotName);
+  bool saveAs(TCanvas* can, const TString &fileName) const;
+  void waitForRenderProcess();
 };
 #endif
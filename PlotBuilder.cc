@@ -8,7 +8,9 @@
 #include "TStyle.h"
 
 #include "GlobalParameters.h"
+#include "Manifest.h"
 #include "PlotBuilder.h"
+#include "Profiler.h"
 #include "Selection.h"
 #include "Style.h"
 #include "Variable.h"
@@ -17,9 +19,27 @@
 unsigned int PlotBuilder::count_ = 0;
 
 
+// Mark the plotted variables as used. Unknown variables are
+// ignored here and reported when the plots are created.
+void PlotBuilder::useVariables(const Config &cfg) {
+  std::vector<Config::Attributes> attrList = cfg("plot");
+  for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
+      it != attrList.end(); ++it) {
+    if( it->hasName("variable") ) {
+      std::vector<TString> variables;
+      Config::split(it->value("variable")," vs ",variables);
+      for(std::vector<TString>::const_iterator itv = variables.begin();
+	  itv != variables.end(); ++itv) {
+	if( Variable::exists(*itv) ) Variable::use(*itv);
+      }
+    }
+  }
+}
+
+
 PlotBuilder::PlotBuilder(const Config &cfg, Output &out)
   : canSize_(500), out_(out) {
-  run(cfg,"plot");
+  init(cfg,"plot");
 }
 
 
@@ -28,10 +48,9 @@ PlotBuilder::~PlotBuilder() {
 }
 
 
-void PlotBuilder::run(const Config &cfg, const TString &key) const {
-  std::cout << "  - Creating control plots" << std::endl;
-
-  //// Loop over the config lines
+// Parse the plots from the config and book their histograms
+void PlotBuilder::init(const Config &cfg, const TString &key) {
+  //// Loop over the config lines and collect the plots
   std::vector<Config::Attributes> attrList = cfg(key);
   for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
       it != attrList.end(); ++it) {
@@ -56,12 +75,12 @@ void PlotBuilder::run(const Config &cfg, const TString &key) const {
       for(std::vector<TString>::const_iterator itv = variables.begin();
 	  itv != variables.end(); ++itv) {
 	if( !Variable::exists(*itv) ) {
-	  std::cerr << "\n\nERROR in PlotBuilder::run(): variable '" << *itv << "' does not exist" << std::endl;
+	  std::cerr << "\n\nERROR in PlotBuilder::init(): variable '" << *itv << "' does not exist" << std::endl;
 	  exit(-1);
 	}
       }
       if( variables.size() > 2 ) {
-	std::cerr << "\n\nERROR in PlotBuilder::run(): no plot type supports more than two variables" << std::endl;
+	std::cerr << "\n\nERROR in PlotBuilder::init(): no plot type supports more than two variables" << std::endl;
 	exit(-1);
       }
 
@@ -102,32 +121,24 @@ void PlotBuilder::run(const Config &cfg, const TString &key) const {
 	for(std::vector<TString>::const_iterator itd = dataSetLabels.begin();
 	    itd != dataSetLabels.end(); ++itd) {
  	  if( !DataSet::labelExists(*itd) ) {
- 	    std::cerr << "\n\nERROR in PlotBuilder::run(): dataset '" << *itd << "' does not exist" << std::endl;
+ 	    std::cerr << "\n\nERROR in PlotBuilder::init(): dataset '" << *itd << "' does not exist" << std::endl;
  	    exit(-1);
  	  }
 	}
 
-	// For each selection, get the dataset(s) and make the plots
+	// For each selection, get the dataset(s)
+	Plot plot(plotType,plotDim,variables,histParams);
+	plot.key_ = Manifest::key(key,*it);
+	plot.isUpToDate_ = Manifest::isUpToDate(plot.key_);
 	for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
 	  DataSets dataSets;
 	  for(std::vector<TString>::const_iterator itd = dataSetLabels.begin();
 	      itd != dataSetLabels.end(); ++itd) {
 	    dataSets.push_back(DataSet::find(*itd,*its));
 	  }
-	  if( plotDim == "1D" ) {
-	    if( plotType == "SingleDistribution" ) {
-	      plotDistribution(variables.front(),dataSets.front(),histParams);
-	    } else if( plotType == "StackedDistributions" ) {
-	      plotStackedDistributions(variables.front(),dataSets,histParams);
-	    } else if( plotType == "ComparedDistributions" ) {
-	      plotComparedDistributions(variables.front(),dataSets,histParams);
-	    } else if( plotType == "FractionalDistributions" ) {
-	      plotFractionalDistributions(variables.front(),dataSets,histParams);
-	    }
-	  } else if( plotDim == "2D" ) {
-	    plotDistribution2D(variables.at(1),variables.at(0),dataSets.front(),histParams);
-	  }
+	  plot.dataSets_.push_back(dataSets);
 	}
+	plots_.push_back(plot);
 
 
       } else if( it->hasName("data") && it->hasName("background") ) {
@@ -144,27 +155,30 @@ void PlotBuilder::run(const Config &cfg, const TString &key) const {
 
 	// Check whether datasets exist
 	if( !DataSet::labelExists(dataLabel) ) {
-	  std::cerr << "\n\nERROR in PlotBuilder::run(): dataset '" << dataLabel << "' does not exist" << std::endl;
+	  std::cerr << "\n\nERROR in PlotBuilder::init(): dataset '" << dataLabel << "' does not exist" << std::endl;
 	  exit(-1);
 	}
 	for(std::vector<TString>::const_iterator itd = bkgLabels.begin();
 	    itd != bkgLabels.end(); ++itd) {
  	  if( !DataSet::labelExists(*itd) ) {
- 	    std::cerr << "\n\nERROR in PlotBuilder::run(): dataset '" << *itd << "' does not exist" << std::endl;
+ 	    std::cerr << "\n\nERROR in PlotBuilder::init(): dataset '" << *itd << "' does not exist" << std::endl;
  	    exit(-1);
  	  }
 	}
 	for(std::vector<TString>::const_iterator itd = signalLabels.begin();
 	    itd != signalLabels.end(); ++itd) {
  	  if( !DataSet::labelExists(*itd) ) {
- 	    std::cerr << "\n\nERROR in PlotBuilder::run(): dataset '" << *itd << "' does not exist" << std::endl;
+ 	    std::cerr << "\n\nERROR in PlotBuilder::init(): dataset '" << *itd << "' does not exist" << std::endl;
  	    exit(-1);
  	  }
 	}
 	
-	// For each selection, plot data vs bkg
+	// For each selection, get data, bkgs, and signals
+	Plot plot(plotType,"1D",variables,histParams);
+	plot.key_ = Manifest::key(key,*it);
+	plot.isUpToDate_ = Manifest::isUpToDate(plot.key_);
 	for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
-	  const DataSet* data = DataSet::find(dataLabel,*its);
+	  DataSets data(1,DataSet::find(dataLabel,*its));
 	  DataSets bkgs;
 	  for(std::vector<TString>::const_iterator itd = bkgLabels.begin();
 	      itd != bkgLabels.end(); ++itd) {
@@ -175,17 +189,118 @@ void PlotBuilder::run(const Config &cfg, const TString &key) const {
 	      itd != signalLabels.end(); ++itd) {
 	    signals.push_back(DataSet::find(*itd,*its));
 	  }
-	  plotDataVsBkg(variables.front(),data,bkgs,signals,histParams);
+	  plot.dataSets_.push_back(data);
+	  plot.bkgs_.push_back(bkgs);
+	  plot.signals_.push_back(signals);
 	}
+	plots_.push_back(plot);
       }
     } else {
       // no 'plot' or 'histogram' definitions
-      std::cerr << "\n\nERROR in PlotBuilder::run(): wrong syntax" << std::endl;
+      std::cerr << "\n\nERROR in PlotBuilder::init(): wrong syntax" << std::endl;
       std::cerr << "  in line with key '" << key << "'" << std::endl;
       std::cerr << "  in config file '" << cfg.fileName() << "'" << std::endl;
       exit(-1);
     }
   } // End of loop over config lines
+
+
+  //// Book the histograms of all outdated plots
+  for(std::vector<Plot>::const_iterator itp = plots_.begin();
+      itp != plots_.end(); ++itp) {
+    if( !itp->isUpToDate_ ) book(*itp,profileName("fill",itp-plots_.begin()));
+  }
+}
+
+
+void PlotBuilder::process(const DataSet* dataSet) {
+  Profiler::Timer timer("PlotBuilder::fill");
+  filler_.fill(dataSet);
+}
+
+
+void PlotBuilder::run() {
+  std::cout << "  - Creating control plots" << std::endl;
+  unsigned int nUpToDate = 0;
+  for(std::vector<Plot>::const_iterator itp = plots_.begin();
+      itp != plots_.end(); ++itp) {
+    if( itp->isUpToDate_ ) ++nUpToDate;
+  }
+  if( nUpToDate > 0 ) std::cout << "     (" << nUpToDate << " of " << plots_.size() << " plots are up to date)" << std::endl;
+
+  //// Fill the histograms in one pass over the events of each
+  //// dataset, unless they have been filled while streaming
+  if( GlobalParameters::chunkSize() == 0 ) {
+    Profiler::Timer timer("PlotBuilder::fill");
+    filler_.fill();
+  }
+
+  //// Draw the plots from the filled histograms. The time to
+  //// store the canvases (see storeCanvas()) is recorded separately.
+  for(std::vector<Plot>::const_iterator itp = plots_.begin();
+      itp != plots_.end(); ++itp) {
+    if( itp->isUpToDate_ ) continue;
+    const unsigned int nFiles = out_.files().size();
+    TStopwatch watch;
+    watch.Start();
+    saveWatch_.Reset();
+    for(unsigned int sel = 0; sel < itp->dataSets_.size(); ++sel) {
+      const DataSets &dataSets = itp->dataSets_.at(sel);
+      if( itp->type_ == "DataVsBackground" ) {
+	plotDataVsBkg(itp->vars_.front(),dataSets.front(),itp->bkgs_.at(sel),itp->signals_.at(sel),itp->histParams_);
+      } else if( itp->dim_ == "1D" ) {
+	if( itp->type_ == "SingleDistribution" ) {
+	  plotDistribution(itp->vars_.front(),dataSets.front(),itp->histParams_);
+	} else if( itp->type_ == "StackedDistributions" ) {
+	  plotStackedDistributions(itp->vars_.front(),dataSets,itp->histParams_);
+	} else if( itp->type_ == "ComparedDistributions" ) {
+	  plotComparedDistributions(itp->vars_.front(),dataSets,itp->histParams_);
+	} else if( itp->type_ == "FractionalDistributions" ) {
+	  plotFractionalDistributions(itp->vars_.front(),dataSets,itp->histParams_);
+	}
+      } else if( itp->dim_ == "2D" ) {
+	plotDistribution2D(itp->vars_.at(1),itp->vars_.at(0),dataSets.front(),itp->histParams_);
+      }
+    }
+    watch.Stop();
+    const unsigned int plotIdx = itp-plots_.begin();
+    Profiler::add(profileName("draw",plotIdx),watch.RealTime()-saveWatch_.RealTime(),watch.CpuTime()-saveWatch_.CpuTime());
+    Profiler::add(profileName("save",plotIdx),saveWatch_.RealTime(),saveWatch_.CpuTime());
+    Manifest::update(itp->key_,std::vector<TString>(out_.files().begin()+nFiles,out_.files().end()));
+  }
+}
+
+
+// Name of the Profiler entry of a step ("fill", "draw", "save")
+// of the plot 'plotIdx', e.g. "PlotBuilder::fill 3: StackedDistributions HT"
+TString PlotBuilder::profileName(const TString &step, unsigned int plotIdx) const {
+  const Plot &plot = plots_.at(plotIdx);
+  TString name = "PlotBuilder::"+step+" ";
+  name += plotIdx;
+  name += ": "+plot.type_+" "+plot.vars_.front();
+  if( plot.vars_.size() > 1 ) name += " vs "+plot.vars_.at(1);
+
+  return name;
+}
+
+
+// Book the histograms of all datasets shown in 'plot'
+void PlotBuilder::book(const Plot &plot, const TString &profileName) {
+  for(unsigned int sel = 0; sel < plot.dataSets_.size(); ++sel) {
+    DataSets dataSets = plot.dataSets_.at(sel);
+    if( plot.type_ == "DataVsBackground" ) {
+      dataSets.insert(dataSets.end(),plot.bkgs_.at(sel).begin(),plot.bkgs_.at(sel).end());
+      dataSets.insert(dataSets.end(),plot.signals_.at(sel).begin(),plot.signals_.at(sel).end());
+    }
+    const HistParams &hp = plot.histParams_;
+    for(DataSetIt itd = dataSets.begin(); itd != dataSets.end(); ++itd) {
+      if( plot.dim_ == "2D" ) {
+	filler_.book2D(*itd,plot.vars_.at(1),plot.vars_.at(0),hp.nBinsX(),hp.xMin(),hp.xMax(),hp.nBinsY(),hp.yMin(),hp.yMax(),profileName);
+      } else {
+	filler_.book1D(*itd,plot.vars_.front(),hp.nBinsX(),hp.xMin(),hp.xMax(),profileName);
+      }
+    }
+  }
 }
 
 
@@ -631,11 +746,10 @@ void PlotBuilder::plotDataVsBkg(const TString &var, const DataSet *data, const D
 void PlotBuilder::createDistribution1D(const DataSet *dataSet, const TString &var, TH1* &h, TGraphAsymmErrors* &uncert, const HistParams &histParams) const {
   ++PlotBuilder::count_;
   
-  // Create histogram  
+  // Get histogram (filled before by the HistFiller)
   TString name = "plot";
   name += count_;
-  h = new TH1D(name,"",histParams.nBinsX(),histParams.xMin(),histParams.xMax());
-  h->Sumw2();
+  h = static_cast<TH1*>(filler_.hist1D(dataSet,var,histParams.nBinsX(),histParams.xMin(),histParams.xMax())->Clone(name));
   if( histParams.xMax() > 1000. ) {
     h->GetXaxis()->SetNdivisions(505);
   }
@@ -643,19 +757,9 @@ void PlotBuilder::createDistribution1D(const DataSet *dataSet, const TString &va
   setYTitle(h,var);
   setGenericStyle(h,dataSet);
 
-  // Create temporary histograms to store uncertainties
-  TH1* hDn = static_cast<TH1*>(h->Clone(name+"Dn"));
-  TH1* hUp = static_cast<TH1*>(h->Clone(name+"Up"));
-
-  // Fill distributions
-  for(EventIt itd = dataSet->evtsBegin(); itd != dataSet->evtsEnd(); ++itd) {
-    double v = (*itd)->get(var);
-    h->Fill(v,(*itd)->weight());
-    if( (*itd)->hasUnc() ) {
-      hDn->Fill(v,(*itd)->weightUncDn());
-      hUp->Fill(v,(*itd)->weightUncUp());
-    }
-  }
+  // Temporary histograms to store uncertainties
+  TH1* hDn = static_cast<TH1*>(filler_.hist1DDn(dataSet,var,histParams.nBinsX(),histParams.xMin(),histParams.xMax())->Clone(name+"Dn"));
+  TH1* hUp = static_cast<TH1*>(filler_.hist1DUp(dataSet,var,histParams.nBinsX(),histParams.xMin(),histParams.xMax())->Clone(name+"Up"));
 
   // Fill overflow bin
   if( histParams.hasOverflowBin() ) {
@@ -713,11 +817,10 @@ void PlotBuilder::createDistribution1D(const DataSet *dataSet, const TString &va
 void PlotBuilder::createDistribution2D(const DataSet *dataSet, const TString &var1, const TString &var2, TH2* &h, const HistParams &histParams) const {
   ++PlotBuilder::count_;
   
-  // Create histogram  
+  // Get histogram (filled before by the HistFiller)
   TString name = "plot";
   name += count_;
-  h = new TH2D(name,"",histParams.nBinsX(),histParams.xMin(),histParams.xMax(),histParams.nBinsY(),histParams.yMin(),histParams.yMax());
-  h->Sumw2();
+  h = static_cast<TH2*>(filler_.hist2D(dataSet,var1,var2,histParams.nBinsX(),histParams.xMin(),histParams.xMax(),histParams.nBinsY(),histParams.yMin(),histParams.yMax())->Clone(name));
   if( histParams.xMax() > 1000. ) {
     h->GetXaxis()->SetNdivisions(505);
   }
@@ -726,11 +829,6 @@ void PlotBuilder::createDistribution2D(const DataSet *dataSet, const TString &va
   }
   setXTitle(h,var1);
   setYTitle(h,var2);
-
-  // Fill distribution
-  for(EventIt itd = dataSet->evtsBegin(); itd != dataSet->evtsEnd(); ++itd) {
-    h->Fill((*itd)->get(var1),(*itd)->get(var2),(*itd)->weight());
-  }
 }
 
 
@@ -757,14 +855,16 @@ void PlotBuilder::createDistributionRatio(const DataSet *dataSet, const TString
   TH1* hUp = static_cast<TH1*>(h->Clone(name+"Up"));
 
   // Fill distributions
+  const unsigned int varIdx1 = Variable::index(var1);
+  const unsigned int varIdx2 = Variable::index(var2);
   for(EventIt itd = dataSet->evtsBegin(); itd != dataSet->evtsEnd(); ++itd) {
-    double v1 = (*itd)->get(var1);
-    double v2 = (*itd)->get(var2);
+    double v1 = itd->get(varIdx1);
+    double v2 = itd->get(varIdx2);
     if( v2 > 0. ) v1 /= v2;
-    h->Fill(v1,(*itd)->weight());
-    if( (*itd)->hasUnc() ) {
-      hDn->Fill(v1,(*itd)->weightUncDn());
-      hUp->Fill(v1,(*itd)->weightUncUp());
+    h->Fill(v1,itd->weight());
+    if( itd->hasUnc() ) {
+      hDn->Fill(v1,itd->weightUncDn());
+      hUp->Fill(v1,itd->weightUncUp());
     }
   }
 
@@ -860,7 +960,9 @@ void PlotBuilder::createStack1D(const DataSets &dataSets, const TString &var, st
 
 
 void PlotBuilder::storeCanvas(TCanvas* can, const TString &var, const DataSet* dataSet) const {
+  saveWatch_.Start(kFALSE);
   out_.addPlot(can,var,dataSet->label(),dataSet->selectionUid());
+  saveWatch_.Stop();
 }
 
 void PlotBuilder::storeCanvas(TCanvas* can, const TString &var, const DataSets &dataSets, const TString &plotType) const {
@@ -868,7 +970,9 @@ void PlotBuilder::storeCanvas(TCanvas* can, const TString &var, const DataSets &
     for(DataSetIt itd = dataSets.begin(); itd != dataSets.end(); ++itd) {
       dataSetLabels.push_back((*itd)->label());
     }
+    saveWatch_.Start(kFALSE);
     out_.addPlot(can,var,dataSetLabels,plotType,dataSets.front()->selectionUid());
+    saveWatch_.Stop();
   }
 
 void PlotBuilder::storeCanvas(TCanvas* can, const TString &var, const DataSet *dataSet, const DataSets &dataSets) const {
@@ -878,7 +982,9 @@ void PlotBuilder::storeCanvas(TCanvas* can, const TString &var, const DataSet *d
     for(DataSetIt itd = dataSets.begin(); itd != dataSets.end(); ++itd) {
       dataSetLabels2.push_back((*itd)->label());
     }
+    saveWatch_.Start(kFALSE);
     out_.addPlot(can,var,dataSetLabels1,dataSetLabels2,dataSet->selectionUid());
+    saveWatch_.Stop();
   }
 
 
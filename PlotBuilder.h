@@ -10,18 +10,30 @@
 #include "TH2.h"
 #include "TLegend.h"
 #include "TPaveText.h"
+#include "TStopwatch.h"
 #include "TString.h"
 
 #include "Config.h"
 #include "DataSet.h"
+#include "EventConsumer.h"
+#include "HistFiller.h"
 #include "Output.h"
 
 
-class PlotBuilder {
+// Creates the control plots defined in the config. The plots are
+// booked at construction; run() fills and draws them. In streaming
+// mode, the histograms are filled chunk-wise by process() before.
+// In incremental mode, up-to-date plots are neither booked nor drawn.
+class PlotBuilder : public EventConsumer {
 public:
+  static void useVariables(const Config &cfg);
+
   PlotBuilder(const Config &cfg, Output &out);
   ~PlotBuilder();
 
+  void process(const DataSet* dataSet);
+  void run();
+
 private:
   class HistParams {
   public:
@@ -54,13 +66,36 @@ private:
     bool hasOverflowBin_;
   };
 
+  // A plot as defined in one config line. The datasets
+  // are stored per selection.
+  class Plot {
+  public:
+    Plot(const TString &type, const TString &dim, const std::vector<TString> &vars, const HistParams &histParams)
+      : type_(type), dim_(dim), vars_(vars), histParams_(histParams), isUpToDate_(false) {};
+
+    TString type_;
+    TString dim_;
+    std::vector<TString> vars_;
+    HistParams histParams_;
+    TString key_;		// See Manifest
+    bool isUpToDate_;
+    std::vector<DataSets> dataSets_;	// For 'DataVsBackground', the data
+    std::vector<DataSets> bkgs_;
+    std::vector<DataSets> signals_;
+  };
+
   static unsigned int count_;
 
   const unsigned int canSize_;
 
   Output &out_;
+  HistFiller filler_;
+  std::vector<Plot> plots_;
+  mutable TStopwatch saveWatch_;	// Time storing the canvases of the current plot
 
-  void run(const Config &cfg, const TString &key) const;
+  void init(const Config &cfg, const TString &key);
+  TString profileName(const TString &step, unsigned int plotIdx) const;
+  void book(const Plot &plot, const TString &profileName);
   void plotDistribution(const TString &var, const DataSet *dataSet, const HistParams &histParams) const;
   void plotDistribution2D(const TString &var1, const TString &var2, const DataSet *dataSet, const HistParams &histParams) const;
   void plotStackedDistributions(const TString &var, const DataSets &dataSets, const HistParams &histParams) const;
@@ -0,0 +1,117 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "Profiler.h"
+
+
+TMutex Profiler::mutex_;
+std::vector<TString> Profiler::names_;
+std::map<TString,Profiler::Entry> Profiler::entries_;
+
+
+// ---------------------------------------------------------------
+void Profiler::Timer::stop() {
+  if( isRunning_ ) {
+    watch_.Stop();
+    isRunning_ = false;
+    Profiler::add(name_,watch_.RealTime(),watch_.CpuTime());
+  }
+}
+
+
+// Add 'value' to the counter 'counter' of entry 'name'
+// ---------------------------------------------------------------
+void Profiler::count(const TString &name, const TString &counter, double value) {
+  mutex_.Lock();
+  entry(name).counters_[counter] += value;
+  mutex_.UnLock();
+}
+
+
+// ---------------------------------------------------------------
+void Profiler::add(const TString &name, double realTime, double cpuTime) {
+  mutex_.Lock();
+  Entry &e = entry(name);
+  ++e.calls_;
+  e.realTime_ += realTime;
+  e.cpuTime_ += cpuTime;
+  mutex_.UnLock();
+}
+
+
+// The entry 'name', which is created if it does not exist.
+// The mutex has to be locked.
+// ---------------------------------------------------------------
+Profiler::Entry& Profiler::entry(const TString &name) {
+  std::map<TString,Entry>::iterator it = entries_.find(name);
+  if( it == entries_.end() ) {
+    names_.push_back(name);
+    it = entries_.insert(std::make_pair(name,Entry())).first;
+  }
+
+  return it->second;
+}
+
+
+// Writes one object per entry, in the order of first use. For
+// entries with an 'entries' or 'bytes' counter, the rate is added.
+// ---------------------------------------------------------------
+void Profiler::write(const TString &fileName) {
+  std::ofstream file(fileName.Data());
+  if( !file.is_open() ) {
+    std::cerr << "\nWARNING in Profiler: cannot write file '" << fileName << "'" << std::endl;
+    return;
+  }
+
+  mutex_.Lock();
+  file << std::setprecision(12);
+  file << "{\n  \"timers\": [";
+  for(unsigned int i = 0; i < names_.size(); ++i) {
+    const Entry &e = entries_[names_[i]];
+    file << (i > 0 ? "," : "") << "\n    {";
+    file << " \"name\": " << quoted(names_[i]);
+    file << ", \"calls\": " << e.calls_;
+    file << ", \"real_s\": " << e.realTime_;
+    file << ", \"cpu_s\": " << e.cpuTime_;
+    if( e.counters_.size() > 0 ) {
+      file << ", \"counters\": {";
+      for(std::map<TString,double>::const_iterator it = e.counters_.begin();
+	  it != e.counters_.end(); ++it) {
+	file << (it != e.counters_.begin() ? ", " : " ") << quoted(it->first) << ": " << it->second;
+      }
+      file << " }";
+      std::map<TString,double>::const_iterator it = e.counters_.find("entries");
+      if( it != e.counters_.end() && e.realTime_ > 0. ) {
+	file << ", \"entries_per_s\": " << it->second/e.realTime_;
+      }
+      it = e.counters_.find("bytes");
+      if( it != e.counters_.end() && e.realTime_ > 0. ) {
+	file << ", \"bytes_per_s\": " << it->second/e.realTime_;
+      }
+    }
+    file << " }";
+  }
+  file << "\n  ]\n}" << std::endl;
+  mutex_.UnLock();
+}
+
+
+// ---------------------------------------------------------------
+TString Profiler::quoted(const TString &str) {
+  TString result = "\"";
+  for(int i = 0; i < str.Length(); ++i) {
+    const char c = str[i];
+    if( c == '"' || c == '\\' ) {
+      result += '\\';
+      result += c;
+    } else if( static_cast<unsigned char>(c) < 0x20 ) {
+      result += ' ';
+    } else {
+      result += c;
+    }
+  }
+  result += "\"";
+
+  return result;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <map>
+#include <vector>
+
+#include "TMutex.h"
+#include "TStopwatch.h"
+#include "TString.h"
+
+
+// Collects the time spent in the phases of a run and counters such
+// as the number of events read. A Timer adds the time from its
+// creation until stop() or its destruction to the entry with its
+// name; times and counters of entries with the same name are summed.
+// Timers and counters may be used from several threads.
+// The summary is written as JSON file if 'global :: profile: true'.
+class Profiler {
+public:
+  class Timer {
+  public:
+    Timer(const TString &name) : name_(name), isRunning_(true) { watch_.Start(); }
+    ~Timer() { stop(); }
+
+    void stop();
+
+  private:
+    const TString name_;
+    TStopwatch watch_;
+    bool isRunning_;
+  };
+
+  static void count(const TString &name, const TString &counter, double value);
+  // Adds the time measured elsewhere, e.g. of interleaved steps
+  static void add(const TString &name, double realTime, double cpuTime);
+  static void write(const TString &fileName);
+
+
+private:
+  class Entry {
+  public:
+    Entry() : calls_(0), realTime_(0.), cpuTime_(0.) {};
+
+    unsigned int calls_;
+    double realTime_;
+    double cpuTime_;		// CPU time of the process, i.e. of all threads
+    std::map<TString,double> counters_;
+  };
+
+  static TMutex mutex_;
+  static std::vector<TString> names_; // In the order of first use
+  static std::map<TString,Entry> entries_;
+
+  static Entry& entry(const TString &name);
+  static TString quoted(const TString &str);
+};
+#endif
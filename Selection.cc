@@ -1,15 +1,19 @@
 #include <iostream>
 #include <cstdlib>
+#include <set>
 
 #include "Config.h"
 #include "Event.h"
 #include "Filter.h"
+#include "GlobalParameters.h"
+#include "Profiler.h"
 #include "Selection.h"
 
 
 std::vector<Selection*> Selection::selections_; // Collection of selections to be returned
 bool Selection::isInit_ = false;
 bool Selection::printFilterTree_ = false;
+std::map<TString,FilterProgram::Slots> Selection::slots_;
 
 
 // Create different selections as specified in a config file
@@ -19,6 +23,7 @@ bool Selection::printFilterTree_ = false;
 // ...; cuts: [cut1] ([dataset1],[dataset2],...) + [cut2] + ...
 // ---------------------------------------------------------------
 void Selection::init(const Config &cfg, const TString key) {
+  Profiler::Timer timer("Selection::init");
   if( isInit_ ) {
     std::cerr << "WARNING: Selections already initialized. Skipping." << std::endl;
   } else {
@@ -26,7 +31,7 @@ void Selection::init(const Config &cfg, const TString key) {
 
     std::vector<Config::Attributes> attrList = cfg(key);
     if( attrList.size() == 0 ) { // No selections specified
-      selections_.push_back(new Selection("unselected",new FilterTRUE()));
+      selections_.push_back(new Selection("unselected",new FilterTRUE(),selections_.size()));
     }
     for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
 	it != attrList.end(); ++it) {
@@ -41,7 +46,7 @@ void Selection::init(const Config &cfg, const TString key) {
 	const Filter* filter = Filter::create(it->value("cuts"),dataSetLabels,it->lineNumber(),it->value("label"));	
 	
 	// Add this selection to the list of full selections
-	selections_.push_back(new Selection(it->value("label"),filter));
+	selections_.push_back(new Selection(it->value("label"),filter,selections_.size()));
 
       } else if( it->hasName("print") ) {
 	if( it->isBoolean("print") ) {
@@ -58,6 +63,22 @@ void Selection::init(const Config &cfg, const TString key) {
 	exit(-1);
       }
     }
+
+    // Specialize the selections to each dataset such that the
+    // dataset restrictions are resolved before the event loop
+    FilterProgram::setSampling(GlobalParameters::adaptiveCutOrder());
+    attrList = cfg("dataset");
+    for(std::vector<Config::Attributes>::const_iterator it = attrList.begin();
+	it != attrList.end(); ++it) {
+      if( !it->hasName("label") ) continue;
+      for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+	(*its)->specialize(it->value("label"));
+      }
+      assignSlots(it->value("label"));
+      for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+	(*its)->compile(it->value("label"));
+      }
+    }
     isInit_ = true;
     std::cout << "ok" << std::endl;
   }
@@ -72,10 +93,173 @@ void Selection::clear() {
       it != selections_.end(); ++it) {
     delete *it;
   }
+  slots_.clear();
   Filter::clear();
 }
 
 
+// ---------------------------------------------------------------
+void Selection::reorder() {
+  FilterProgram::setSampling(false);
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    for(std::map<TString,FilterProgram>::iterator it = (*its)->programs_.begin();
+	it != (*its)->programs_.end(); ++it) {
+      it->second.reorder();
+    }
+    for(std::map<TString,FilterProgram>::iterator it = (*its)->residuals_.begin();
+	it != (*its)->residuals_.end(); ++it) {
+      it->second.reorder();
+    }
+  }
+}
+
+
+// The pass rates of the operands on the sampled events and the
+// operands that are evaluated in a different order
+// ---------------------------------------------------------------
+void Selection::printCutOrder() {
+  if( !GlobalParameters::adaptiveCutOrder() ) return;
+
+  std::cout << "The operands of AND and OR are evaluated in the order learned on the first events:" << std::endl;
+  std::multimap<TString,const FilterProgram::Statistics*> stats;
+  for(std::map<const Filter*,FilterProgram::Statistics>::const_iterator it = FilterProgram::statistics().begin();
+      it != FilterProgram::statistics().end(); ++it) {
+    if( it->second.nEvents_ > 0 ) stats.insert(std::make_pair(it->first->uid(),&(it->second)));
+  }
+  if( stats.size() > 0 ) std::cout << "  pass rate  cost      events   operand" << std::endl;
+  for(std::multimap<TString,const FilterProgram::Statistics*>::const_iterator it = stats.begin();
+      it != stats.end(); ++it) {
+    std::cout << TString::Format("  %9.4f  %4u  %10llu   [%s]",it->second->passRate(),it->second->cost_,static_cast<unsigned long long>(it->second->nEvents_),it->first.Data()) << std::endl;
+  }
+
+  std::set<TString> reorderings;
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    for(std::map<TString,FilterProgram>::const_iterator it = (*its)->programs_.begin();
+	it != (*its)->programs_.end(); ++it) {
+      reorderings.insert(it->second.reorderings().begin(),it->second.reorderings().end());
+    }
+    for(std::map<TString,FilterProgram>::const_iterator it = (*its)->residuals_.begin();
+	it != (*its)->residuals_.end(); ++it) {
+      reorderings.insert(it->second.reorderings().begin(),it->second.reorderings().end());
+    }
+  }
+  if( reorderings.size() == 0 ) std::cout << "  All operands are evaluated in the order of the config" << std::endl;
+  for(std::set<TString>::const_iterator it = reorderings.begin();
+      it != reorderings.end(); ++it) {
+    std::cout << "  " << *it << std::endl;
+  }
+  std::cout << "\n";
+}
+
+
+// ---------------------------------------------------------------
+const Selection* Selection::find(const TString &uid) {
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    if( (*its)->uid() == uid ) return *its;
+  }
+  std::cerr << "\n\nERROR in Selection::find(): selection '" << uid << "' does not exist" << std::endl;
+  exit(-1);
+
+  return 0;
+}
+
+
+// ---------------------------------------------------------------
+const Filter* Selection::filter(const TString &dataSetLabel) const {
+  std::map<TString,const Filter*>::const_iterator it = filters_.find(dataSetLabel);
+  if( it == filters_.end() ) {
+    std::cerr << "\n\nERROR in Selection::filter(): selection '" << uid() << "' has not been specialized to dataset '" << dataSetLabel << "'" << std::endl;
+    exit(-1);
+  }
+
+  return it->second;
+}
+
+
+// ---------------------------------------------------------------
+const FilterProgram& Selection::program(const TString &dataSetLabel, bool refined) const {
+  if( refined && parent(dataSetLabel) != 0 ) return residuals_.find(dataSetLabel)->second;
+  std::map<TString,FilterProgram>::const_iterator it = programs_.find(dataSetLabel);
+  if( it == programs_.end() ) {
+    std::cerr << "\n\nERROR in Selection::program(): selection '" << uid() << "' has not been specialized to dataset '" << dataSetLabel << "'" << std::endl;
+    exit(-1);
+  }
+
+  return it->second;
+}
+
+
+// ---------------------------------------------------------------
+const Selection* Selection::parent(const TString &dataSetLabel) const {
+  std::map<TString,const Selection*>::const_iterator it = parents_.find(dataSetLabel);
+
+  return it != parents_.end() ? it->second : 0;
+}
+
+
+// ---------------------------------------------------------------
+void Selection::apply(const EventStore &store, const TString &dataSetLabel, EventMask &mask) const {
+  program(dataSetLabel).run(store,0,store.size(),mask);
+}
+
+
+// Selections are specialized in the order of their definition,
+// such that the parent selections are already specialized. Of
+// the previously defined selections, the latest one that this
+// selection refines is the parent.
+// ---------------------------------------------------------------
+void Selection::specialize(const TString &dataSetLabel) {
+  if( filters_.find(dataSetLabel) != filters_.end() ) return;
+  const Filter* filter = filter_->specialize(dataSetLabel);
+  filters_[dataSetLabel] = filter;
+
+  for(unsigned int i = id(); i > 0; --i) {
+    const Selection* parent = selections_.at(i-1);
+    const Filter* residual = 0;
+    if( filter->refines(parent->filter(dataSetLabel),residual) ) {
+      parents_[dataSetLabel] = parent;
+      residualFilters_[dataSetLabel] = residual;
+      break;
+    }
+  }
+}
+
+
+// The programs of all selections of a dataset share one memo, see
+// DataSet::applySelections(). Only the filters that are evaluated
+// more than once by these programs get a memo slot; filters shared
+// between datasets only are evaluated once per event.
+// ---------------------------------------------------------------
+void Selection::assignSlots(const TString &dataSetLabel) {
+  if( slots_.find(dataSetLabel) != slots_.end() ) return;
+  std::map<const Filter*,unsigned int> uses;
+  std::vector<const Filter*> order;
+  for(SelectionIt its = Selection::begin(); its != Selection::end(); ++its) {
+    std::map<TString,const Filter*>::const_iterator it = (*its)->residualFilters_.find(dataSetLabel);
+    if( it != (*its)->residualFilters_.end() ) it->second->countUses(uses,order);
+    else (*its)->filter(dataSetLabel)->countUses(uses,order);
+  }
+
+  FilterProgram::Slots &slots = slots_[dataSetLabel];
+  for(std::vector<const Filter*>::const_iterator it = order.begin();
+      it != order.end(); ++it) {
+    if( uses[*it] > 1 ) slots.insert(std::make_pair(*it,static_cast<unsigned int>(slots.size())));
+  }
+}
+
+
+// ---------------------------------------------------------------
+void Selection::compile(const TString &dataSetLabel) {
+  if( programs_.find(dataSetLabel) != programs_.end() ) return;
+  const FilterProgram::Slots* slots = &(slots_[dataSetLabel]);
+  programs_.insert(std::make_pair(dataSetLabel,FilterProgram(filter(dataSetLabel),slots)));
+  std::map<TString,const Filter*>::const_iterator it = residualFilters_.find(dataSetLabel);
+  if( it != residualFilters_.end() ) {
+    residuals_.insert(std::make_pair(dataSetLabel,FilterProgram(it->second,slots)));
+  }
+}
+
+
 // ---------------------------------------------------------------
 unsigned int Selection::maxLabelLength() {
   unsigned int s = 0;
@@ -92,4 +276,13 @@ void Selection::print() const {
   if( printFilterTree_ ) std::cout << std::endl;
   std::cout << "  Selection '" << uid() << "'" << std::endl;
   if( printFilterTree_ ) std::cout << filter_->printOut() << std::endl;
+  if( printFilterTree_ && GlobalParameters::debug() ) {
+    for(std::map<TString,FilterProgram>::const_iterator it = programs_.begin();
+	it != programs_.end(); ++it) {
+      std::cout << "  Compiled program for dataset '" << it->first << "':\n" << it->second.printOut() << std::endl;
+      if( parent(it->first) != 0 ) {
+	std::cout << "  Refines selection '" << parent(it->first)->uid() << "' with:\n" << residuals_.find(it->first)->second.printOut() << std::endl;
+      }
+    }
+  }
 }
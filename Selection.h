@@ -1,6 +1,7 @@
 #ifndef SELECTION_H
 #define SELECTION_H
 
+#include <map>
 #include <vector>
 
 #include "TString.h"
@@ -8,6 +9,7 @@
 #include "Config.h"
 #include "Event.h"
 #include "Filter.h"
+#include "FilterProgram.h"
 
 
 class Selection;
@@ -24,21 +26,50 @@ public:
   static SelectionIt end() { return selections_.end(); }
   static unsigned int maxLabelLength();
   static void clear();
+  // Ends the sampling of the adaptive cut order and compiles the
+  // programs again in the learned order, see FilterProgram
+  static void reorder();
+  static void printCutOrder();
 
-  Selection(const TString &uid, const Filter* filter) : uid_(uid), filter_(filter) {};
+  Selection(const TString &uid, const Filter* filter, unsigned int id) : uid_(uid), id_(id), filter_(filter) {};
 
   const Filter* filter() const { return filter_; }
-  bool passes(const Event* evt, const TString &dataSetLabel) const { filter_->passes(evt,dataSetLabel); }
+  // The filter for the events of the dataset 'dataSetLabel',
+  // see Filter::specialize()
+  const Filter* filter(const TString &dataSetLabel) const;
+  // The selection that this selection refines for the dataset
+  // 'dataSetLabel', i.e. whose filter is an operand of the top-level
+  // AND (or chain of ANDs) of this selection's filter, or 0
+  const Selection* parent(const TString &dataSetLabel) const;
+  // Sets the bits of all events in 'store' of the dataset
+  // 'dataSetLabel' that pass the selection. DataSet::applySelections()
+  // runs the programs of all selections together instead.
+  void apply(const EventStore &store, const TString &dataSetLabel, EventMask &mask) const;
+  // The compiled filter for the dataset 'dataSetLabel'; if 'refined',
+  // the program without the parent, to be run on its events
+  const FilterProgram& program(const TString &dataSetLabel, bool refined = false) const;
   void print() const;
   TString uid() const { return uid_; }
+  unsigned int id() const { return id_; }	// Position in the list of selections
 
 
 private:
   static Selections selections_;
   static bool isInit_;
   static bool printFilterTree_;
+  static std::map<TString,FilterProgram::Slots> slots_;	// Per dataset label
 
   const TString uid_;
+  const unsigned int id_;
   const Filter* filter_;
+  std::map<TString,const Filter*> filters_;	// Specialized per dataset label
+  std::map<TString,FilterProgram> programs_;
+  std::map<TString,const Selection*> parents_;
+  std::map<TString,const Filter*> residualFilters_;
+  std::map<TString,FilterProgram> residuals_;	// Program without the parent
+
+  static void assignSlots(const TString &dataSetLabel);
+  void specialize(const TString &dataSetLabel);
+  void compile(const TString &dataSetLabel);
 };
 #endif
@@ -5,6 +5,7 @@
 
 #include "Config.h"
 #include "DataSet.h"
+#include "Profiler.h"
 #include "Selection.h"
 #include "Style.h"
 
@@ -17,6 +18,7 @@ bool Style::plotYields_ = true;
 
 
 void Style::init(const Config &cfg, const TString &key) {
+  Profiler::Timer timer("Style::init");
   std::cout << "  Setting style parameters...  " << std::flush;
 
   // ROOT style-settings
@@ -1,11 +1,14 @@
 #include <cstdlib>
 #include <iostream>
 
+#include "Profiler.h"
 #include "Variable.h"
 
 bool Variable::isInit_ = false;
 std::set<TString> Variable::validTypes_;
 std::vector<TString> Variable::names_;
+std::map<TString,unsigned int> Variable::indices_;
+std::vector<bool> Variable::used_;
 std::map<TString,TString> Variable::types_;
 std::map<TString,TString> Variable::labels_;
 std::map<TString,TString> Variable::units_;
@@ -20,6 +23,7 @@ void Variable::checkIfIsInit() {
 
 
 void Variable::init(const Config &cfg, const TString &key) {
+  Profiler::Timer timer("Variable::init");
   if( !isInit_ ) {
     std::cout << "  Initializing variables...  " << std::flush;
 
@@ -40,7 +44,9 @@ void Variable::init(const Config &cfg, const TString &key) {
 	TString unit = it->value("unit");
 	if( !exists(name) ) {
 	  if( validType(type) ) {
+	    indices_[name] = names_.size();
 	    names_.push_back(name);
+	    used_.push_back(false);
 	    types_[name] = type;
 	    labels_[name] = label;
 	    units_[name] = unit;
@@ -99,6 +105,31 @@ bool Variable::exists(const TString &name) {
 }
 
 
+// Dense index of the variable (its position in the list of
+// variables). Resolve it once and use it to access the event
+// columns instead of looking up the name for each event.
+unsigned int Variable::index(const TString &name) {
+  unsigned int idx = 0;
+  std::map<TString,unsigned int>::const_iterator it = indices_.find(name);
+  if( it != indices_.end() ) {
+    idx = it->second;
+  } else {
+    std::cerr << "\n\nERROR in Variable::index: Variable '" << name << "' not specified." << std::endl;
+    exit(-1);
+  }
+
+  return idx;
+}
+
+
+// Mark the variable as used by a selection, plot, etc. Only used
+// variables are read from the input trees; this has to be done
+// before the datasets are read.
+void Variable::use(const TString &name) {
+  used_.at(index(name)) = true;
+}
+
+
 TString Variable::label(const TString &name) {
   TString label = name;
   std::map<TString,TString>::const_iterator it = labels_.find(name);
@@ -15,6 +15,10 @@ public:
   static void init(const Config &cfg, const TString &key);
   static bool validType(const TString &type);
   static bool exists(const TString &name);
+  static unsigned int index(const TString &name);
+  static void use(const TString &name);
+  static bool isUsed(const TString &name) { return isUsed(index(name)); }
+  static bool isUsed(unsigned int idx) { return used_.at(idx); }
 
   static unsigned int nVars() { return names_.size(); }
   static std::vector<TString>::const_iterator begin() { return names_.begin(); }
@@ -29,6 +33,8 @@ private:
   static bool isInit_;
   static std::set<TString> validTypes_;
   static std::vector<TString> names_;
+  static std::map<TString,unsigned int> indices_;
+  static std::vector<bool> used_;
   static std::map<TString,TString> types_;
   static std::map<TString,TString> labels_;
   static std::map<TString,TString> units_;